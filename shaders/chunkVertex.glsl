@@ -0,0 +1,45 @@
+/* Shared by default.vert and defaultNoHiZ.vert. */
+
+#include "quaternions.glsl"
+#include "uniforms.glsl"
+#include "vertex.glsl"
+
+layout(location=0) in uvec2 inVertex;
+
+/* NOTE: eye and rotation change every frame, so they are pushed rather than
+   read from the uniform buffer, which is shared by every frame in flight. */
+layout(push_constant) uniform PushConstants {
+    vec4 eye;
+    vec4 rotation;
+    /* NOTE: Pushed per draw on devices where the draw can't pick it with
+       firstInstance, w is 0 otherwise. See DrawList.cpp. */
+    vec4 origin;
+} view;
+
+/* The origin of every chunk in the draw list, indexed by the draw's
+   firstInstance. See DrawList.cpp. */
+layout(set=0, binding=1) readonly buffer ChunkOrigins {
+    vec4 origins[];
+} chunks;
+
+layout(location=0) out vec4 outColor;
+layout(location=1) out float outLight;
+
+void main() {
+    vec4 origin = (view.origin.w != 0) ?
+        view.origin :
+        chunks.origins[gl_InstanceIndex];
+    vec4 position = vec4(unpackPosition(inVertex, origin), 1);
+    vec4 normal = vec4(unpackNormal(inVertex), 0);
+
+    vec4 p = position;
+    p -= view.eye;
+    p = rotate_vertex_position(view.rotation, p);
+    p = uniforms.proj * p;
+    gl_Position = p;
+    vec3 lightV = view.eye.xyz - position.xyz;
+    float dist = length(lightV);
+    vec3 lightDir = lightV / dist;
+    outColor = normal;
+    outLight = dot(lightDir, normal.xyz) * (1 / dist);
+}
@@ -1,15 +1,28 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(location=0) in vec4 inColor;
-layout(location=1) in float inLight;
+/* NOTE: So only fragments that pass the depth test write their depth below. */
+layout(early_fragment_tests) in;
 
-layout(location=0) out vec4 outColor;
+#include "chunkFragment.glsl"
+
+/* The first level of the depth pyramid, which hiz.comp reduces after the
+   render pass. See HiZ.cpp. Writing it needs the fragmentStoresAndAtomics
+   feature, defaultNoHiZ.frag is used without it. */
+layout(set=0, binding=2) buffer DepthPyramid {
+    /* x: width, y: height, z: enabled */
+    uvec4 header;
+    uint depths[];
+} pyramid;
 
 void main() {
-    vec3 col = inColor.xyz + vec3(1, 1, 1);
-    col /= 2;
-    float light = clamp(inLight + .3f, 0.f, 1.f);
-    col *= light;
-    outColor = vec4(col, 1);
+    shade();
+
+    if (pyramid.header.z != 0) {
+        uvec2 p = uvec2(gl_FragCoord.xy);
+        atomicMin(
+            pyramid.depths[p.y * pyramid.header.x + p.x],
+            floatBitsToUint(gl_FragCoord.z)
+        );
+    }
 }
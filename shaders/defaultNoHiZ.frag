@@ -0,0 +1,11 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+/* default.frag without the depth pyramid, for when Hi-Z is off. It doesn't
+   store anything, so it doesn't need the fragmentStoresAndAtomics feature. */
+
+#include "chunkFragment.glsl"
+
+void main() {
+    shade();
+}
@@ -0,0 +1,4 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+#include "chunkVertex.glsl"
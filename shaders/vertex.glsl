@@ -0,0 +1,45 @@
+/* Chunk vertices are packed into 8 bytes. x holds the X and Y position, y
+   holds the Z position and an octahedral encoded normal, 16 bits each.
+   Positions are relative to the chunk's origin and in units of its cells, so
+   coarser chunks keep the same range. They're offset by POSITION_BIAS so
+   they're never negative, and quantized to 1 / POSITION_SCALE of a cell.
+   origin.w is the width of a cell.
+   NOTE: Must match packVertex in Generation.cpp. */
+#define POSITION_SCALE 1024.f
+#define POSITION_BIAS 1.f
+
+vec2 octWrap(vec2 v) {
+    return (1.f - abs(v.yx)) * vec2(v.x >= 0.f ? 1.f : -1.f, v.y >= 0.f ? 1.f : -1.f);
+}
+
+/* See https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/ */
+uint encodeNormal(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = (n.z >= 0.f) ? n.xy : octWrap(n.xy);
+    uvec2 q = uvec2(round(clamp(e * .5f + .5f, 0.f, 1.f) * 255.f));
+    return q.x | (q.y << 8);
+}
+
+vec3 decodeNormal(uint bits) {
+    vec2 e = vec2(bits & 0xff, (bits >> 8) & 0xff) / 255.f * 2.f - 1.f;
+    vec3 n = vec3(e, 1.f - abs(e.x) - abs(e.y));
+    float t = clamp(-n.z, 0.f, 1.f);
+    n.x += (n.x >= 0.f) ? -t : t;
+    n.y += (n.y >= 0.f) ? -t : t;
+    return normalize(n);
+}
+
+uvec2 packVertex(vec3 position, vec4 origin, vec3 normal) {
+    vec3 cells = (position - origin.xyz) / origin.w;
+    uvec3 q = uvec3(round((cells + POSITION_BIAS) * POSITION_SCALE));
+    return uvec2(q.x | (q.y << 16), q.z | (encodeNormal(normal) << 16));
+}
+
+vec3 unpackPosition(uvec2 v, vec4 origin) {
+    vec3 q = vec3(v.x & 0xffff, v.x >> 16, v.y & 0xffff);
+    return origin.xyz + (q / POSITION_SCALE - POSITION_BIAS) * origin.w;
+}
+
+vec3 unpackNormal(uvec2 v) {
+    return decodeNormal(v.y >> 16);
+}
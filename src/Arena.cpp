@@ -0,0 +1,319 @@
+// NOTE: Buddy allocator handing out ranges of a few large buffers instead of
+// creating a buffer (and a VkDeviceMemory) per allocation. Every block is one
+// VkBuffer bound to its own memory, split into power of two ranges from
+// arenaMinSize up to arenaBlockSize. Ranges are aligned to their size, which
+// covers every buffer offset alignment Vulkan asks for. Allocations can come
+// from any thread.
+
+const u32 arenaMinShift = 8;
+const u32 arenaBlockShift = 26;
+const u32 arenaOrderCount = arenaBlockShift - arenaMinShift + 1;
+const VkDeviceSize arenaMinSize = 1ull << arenaMinShift;
+const VkDeviceSize arenaBlockSize = 1ull << arenaBlockShift;
+
+struct ArenaBlock {
+    VulkanBuffer buffer;
+    u8* mapped;
+    // NOTE: freeLists may hold stale entries of ranges that have since been
+    // merged with their buddy. isFree is the source of truth.
+    vector<u32> freeLists[arenaOrderCount];
+    vector<u8> isFree[arenaOrderCount];
+    u32 freeCounts[arenaOrderCount];
+    VkDeviceSize usedBytes;
+    u32 allocationCount;
+};
+
+struct Arena;
+
+struct ArenaAllocation {
+    // NOTE: nullptr for an empty allocation.
+    Arena* arena;
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    // NOTE: nullptr unless the arena is host visible.
+    u8* mapped;
+    u32 block;
+    u32 order;
+};
+
+struct Arena {
+    const char* name;
+    SRWLOCK lock;
+    VkBufferUsageFlags usage;
+    VkMemoryPropertyFlags properties;
+    vector<ArenaBlock*> blocks;
+    VkDeviceSize requestedBytes;
+    u64 allocations;
+    u64 frees;
+};
+
+struct ArenaStats {
+    u32 blockCount;
+    u32 allocationCount;
+    VkDeviceSize requestedBytes;
+    VkDeviceSize usedBytes;
+    VkDeviceSize freeBytes;
+    VkDeviceSize largestFree;
+    // NOTE: 1 - largestFree / freeBytes. 0 means all free space is in one range.
+    float fragmentation;
+};
+
+u32 arenaOrder(VkDeviceSize size) {
+    u32 order = 0;
+    while ((arenaMinSize << order) < size) order++;
+    return order;
+}
+
+void arenaPushFree(ArenaBlock* block, u32 order, u32 idx) {
+    block->isFree[order][idx] = 1;
+    block->freeCounts[order]++;
+    auto& freeList = block->freeLists[order];
+    // NOTE: Drop stale entries before they pile up.
+    if (freeList.size() > 2 * block->freeCounts[order] + 16) {
+        u32 kept = 0;
+        for (auto entry: freeList) {
+            if (block->isFree[order][entry]) freeList[kept++] = entry;
+        }
+        freeList.resize(kept);
+    }
+    freeList.push_back(idx);
+}
+
+bool arenaPopFree(ArenaBlock* block, u32 order, u32& idx) {
+    auto& freeList = block->freeLists[order];
+    while (!freeList.empty()) {
+        idx = freeList.back();
+        freeList.pop_back();
+        if (block->isFree[order][idx]) {
+            block->isFree[order][idx] = 0;
+            block->freeCounts[order]--;
+            return true;
+        }
+    }
+    return false;
+}
+
+ArenaBlock* arenaCreateBlock(Arena& arena, Vulkan& vk) {
+    auto block = new ArenaBlock;
+    bufferCreate(
+        vk,
+        arena.usage,
+        arena.properties,
+        arenaBlockSize,
+        block->buffer
+    );
+    block->mapped = nullptr;
+    if (arena.properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        block->mapped = (u8*)mapMemory(vk.device, block->buffer.memory);
+    }
+    for (u32 order = 0; order < arenaOrderCount; order++) {
+        block->isFree[order].resize(arenaBlockSize >> (arenaMinShift + order));
+        block->freeCounts[order] = 0;
+    }
+    arenaPushFree(block, arenaOrderCount - 1, 0);
+    block->usedBytes = 0;
+    block->allocationCount = 0;
+    INFO(
+        "Arena %s: block %d created",
+        arena.name, (u32)arena.blocks.size()
+    );
+    return block;
+}
+
+bool arenaAllocateFromBlock(
+    ArenaBlock* block,
+    u32 order,
+    VkDeviceSize& offset
+) {
+    u32 idx = 0;
+    u32 foundOrder = order;
+    for (; foundOrder < arenaOrderCount; foundOrder++) {
+        if (arenaPopFree(block, foundOrder, idx)) break;
+    }
+    if (foundOrder == arenaOrderCount) return false;
+
+    // NOTE: Split down to the requested order, freeing the upper halves.
+    while (foundOrder > order) {
+        foundOrder--;
+        idx *= 2;
+        arenaPushFree(block, foundOrder, idx + 1);
+    }
+    offset = (VkDeviceSize)idx << (arenaMinShift + order);
+    block->usedBytes += arenaMinSize << order;
+    block->allocationCount++;
+    return true;
+}
+
+// Allocates size bytes, preferring the lowest numbered block so the last
+// blocks drain and can be given back. Grows the arena when it is full, unless
+// avoidBlock is set (see residencyDefragment), in which case it returns false.
+bool arenaAllocate(
+    Arena& arena,
+    Vulkan& vk,
+    VkDeviceSize size,
+    ArenaAllocation& allocation,
+    i32 avoidBlock = -1
+) {
+    CHECK(size <= arenaBlockSize, "arena allocation too large");
+    if (size == 0) size = 1;
+    u32 order = arenaOrder(size);
+
+    AcquireSRWLockExclusive(&arena.lock);
+    u32 blockIdx = 0;
+    VkDeviceSize offset = 0;
+    bool found = false;
+    for (; blockIdx < arena.blocks.size(); blockIdx++) {
+        if ((i32)blockIdx == avoidBlock) continue;
+        auto block = arena.blocks[blockIdx];
+        if (!block) continue;
+        if (arenaAllocateFromBlock(block, order, offset)) {
+            found = true;
+            break;
+        }
+    }
+    if (!found && (avoidBlock >= 0)) {
+        ReleaseSRWLockExclusive(&arena.lock);
+        return false;
+    }
+    if (!found) {
+        // NOTE: Reuse a slot freed by arenaTrim before growing the list.
+        for (blockIdx = 0; blockIdx < arena.blocks.size(); blockIdx++) {
+            if (!arena.blocks[blockIdx]) break;
+        }
+        auto block = arenaCreateBlock(arena, vk);
+        if (blockIdx == arena.blocks.size()) {
+            arena.blocks.push_back(block);
+        } else {
+            arena.blocks[blockIdx] = block;
+        }
+        found = arenaAllocateFromBlock(block, order, offset);
+        CHECK(found, "could not allocate from new arena block");
+    }
+
+    auto block = arena.blocks[blockIdx];
+    allocation.arena = &arena;
+    allocation.buffer = block->buffer.handle;
+    allocation.offset = offset;
+    allocation.size = size;
+    allocation.mapped = block->mapped ? block->mapped + offset : nullptr;
+    allocation.block = blockIdx;
+    allocation.order = order;
+    arena.requestedBytes += size;
+    arena.allocations++;
+    ReleaseSRWLockExclusive(&arena.lock);
+    return true;
+}
+
+void arenaFree(ArenaAllocation& allocation) {
+    if (!allocation.arena) return;
+    auto& arena = *allocation.arena;
+
+    AcquireSRWLockExclusive(&arena.lock);
+    auto block = arena.blocks[allocation.block];
+    u32 order = allocation.order;
+    u32 idx = (u32)(allocation.offset >> (arenaMinShift + order));
+    block->usedBytes -= arenaMinSize << order;
+    block->allocationCount--;
+
+    // NOTE: Merge with the buddy for as long as it is free too.
+    while (order < arenaOrderCount - 1) {
+        u32 buddy = idx ^ 1;
+        if (!block->isFree[order][buddy]) break;
+        block->isFree[order][buddy] = 0;
+        block->freeCounts[order]--;
+        idx >>= 1;
+        order++;
+    }
+    arenaPushFree(block, order, idx);
+
+    arena.requestedBytes -= allocation.size;
+    arena.frees++;
+    ReleaseSRWLockExclusive(&arena.lock);
+    allocation = {};
+}
+
+// Gives empty blocks other than the first back to the driver.
+void arenaTrim(Arena& arena, Vulkan& vk) {
+    AcquireSRWLockExclusive(&arena.lock);
+    for (u32 i = 1; i < arena.blocks.size(); i++) {
+        auto block = arena.blocks[i];
+        if (!block || block->allocationCount) continue;
+        if (block->mapped) unMapMemory(vk.device, block->buffer.memory);
+        destroyBuffer(vk, block->buffer);
+        delete block;
+        arena.blocks[i] = nullptr;
+        INFO("Arena %s: block %d released", arena.name, i);
+    }
+    ReleaseSRWLockExclusive(&arena.lock);
+}
+
+ArenaStats arenaStats(Arena& arena) {
+    ArenaStats stats = {};
+    AcquireSRWLockShared(&arena.lock);
+    for (auto block: arena.blocks) {
+        if (!block) continue;
+        stats.blockCount++;
+        stats.allocationCount += block->allocationCount;
+        stats.usedBytes += block->usedBytes;
+        for (i32 order = arenaOrderCount - 1; order >= 0; order--) {
+            if (block->freeCounts[order]) {
+                VkDeviceSize size = arenaMinSize << order;
+                if (size > stats.largestFree) stats.largestFree = size;
+                break;
+            }
+        }
+    }
+    stats.requestedBytes = arena.requestedBytes;
+    ReleaseSRWLockShared(&arena.lock);
+
+    stats.freeBytes = stats.blockCount * arenaBlockSize - stats.usedBytes;
+    if (stats.freeBytes) {
+        stats.fragmentation = 1.f - (float)stats.largestFree / (float)stats.freeBytes;
+    }
+    return stats;
+}
+
+// Returns the least occupied block if it is under maxOccupancy and everything
+// in it fits into the free space of the other blocks, -1 otherwise. Never the
+// first block: arenaTrim keeps it anyway, and it holds the allocations made
+// at startup, which never move.
+i32 arenaSparsestBlock(Arena& arena, float maxOccupancy) {
+    AcquireSRWLockShared(&arena.lock);
+    i32 sparsest = -1;
+    VkDeviceSize freeBytes = 0;
+    for (u32 i = 0; i < arena.blocks.size(); i++) {
+        auto block = arena.blocks[i];
+        if (!block) continue;
+        freeBytes += arenaBlockSize - block->usedBytes;
+        if (!i || !block->allocationCount) continue;
+        if ((sparsest < 0) ||
+                (block->usedBytes < arena.blocks[sparsest]->usedBytes)) {
+            sparsest = i;
+        }
+    }
+    if (sparsest >= 0) {
+        auto block = arena.blocks[sparsest];
+        VkDeviceSize otherFreeBytes = freeBytes - (arenaBlockSize - block->usedBytes);
+        if ((block->usedBytes > maxOccupancy * arenaBlockSize) ||
+                (block->usedBytes > otherFreeBytes)) {
+            sparsest = -1;
+        }
+    }
+    ReleaseSRWLockShared(&arena.lock);
+    return sparsest;
+}
+
+void initArena(
+    Arena& arena,
+    Vulkan& vk,
+    const char* name,
+    VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags properties
+) {
+    arena.name = name;
+    InitializeSRWLock(&arena.lock);
+    arena.usage = usage;
+    arena.properties = properties;
+    arena.blocks.push_back(arenaCreateBlock(arena, vk));
+}
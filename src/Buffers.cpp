@@ -0,0 +1,118 @@
+// NOTE: The jcwk helpers (createVertexBuffer, createStorageBuffer, ...) each
+// hard code their usage flags and queue family. Buffers that are written by
+// the compute queue and read by the graphics queue, or that serve more than
+// one purpose (e.g. storage + indirect), are created through here instead.
+
+u32 bufferMemoryTypeIndex(
+    Vulkan& vk,
+    u32 memoryTypeBits,
+    VkMemoryPropertyFlags properties
+) {
+    for (u32 i = 0; i < vk.memories.memoryTypeCount; i++) {
+        auto flags = vk.memories.memoryTypes[i].propertyFlags;
+        if ((memoryTypeBits & (1 << i)) && ((flags & properties) == properties)) {
+            return i;
+        }
+    }
+    FATAL("no suitable memory type for buffer");
+}
+
+void bufferCreate(
+    Vulkan& vk,
+    VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags properties,
+    VkDeviceSize size,
+    VulkanBuffer& buffer
+) {
+    u32 queueFamilies[] = { vk.queueFamily, vk.computeQueueFamily };
+
+    VkBufferCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    createInfo.size = size;
+    createInfo.usage = usage;
+    if (vk.queueFamily == vk.computeQueueFamily) {
+        createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    } else {
+        createInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        createInfo.queueFamilyIndexCount = 2;
+        createInfo.pQueueFamilyIndices = queueFamilies;
+    }
+    VKCHECK(
+        vkCreateBuffer(vk.device, &createInfo, nullptr, &buffer.handle),
+        "could not create buffer"
+    );
+
+    VkMemoryRequirements requirements = {};
+    vkGetBufferMemoryRequirements(vk.device, buffer.handle, &requirements);
+
+    VkMemoryAllocateInfo allocateInfo = {};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = requirements.size;
+    allocateInfo.memoryTypeIndex = bufferMemoryTypeIndex(
+        vk,
+        requirements.memoryTypeBits,
+        properties
+    );
+    VKCHECK(
+        vkAllocateMemory(vk.device, &allocateInfo, nullptr, &buffer.memory),
+        "could not allocate buffer memory"
+    );
+    VKCHECK(
+        vkBindBufferMemory(vk.device, buffer.handle, buffer.memory, 0),
+        "could not bind buffer memory"
+    );
+}
+
+// Binds part of a buffer to a storage buffer binding. offset has to be a
+// multiple of minStorageBufferOffsetAlignment, which is at most 256.
+void bufferUpdateStorageRange(
+    Vulkan& vk,
+    VkDescriptorSet descriptorSet,
+    u32 binding,
+    VkBuffer buffer,
+    VkDeviceSize offset,
+    VkDeviceSize range
+) {
+    VkDescriptorBufferInfo bufferInfo = {};
+    bufferInfo.buffer = buffer;
+    bufferInfo.offset = offset;
+    bufferInfo.range = range;
+
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = descriptorSet;
+    write.dstBinding = binding;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = &bufferInfo;
+    vkUpdateDescriptorSets(vk.device, 1, &write, 0, nullptr);
+}
+
+// Makes srcAccess writes by srcStage visible to dstAccess in dstStage, for
+// every buffer.
+void bufferBarrier(
+    VkCommandBuffer cmd,
+    VkPipelineStageFlags srcStage,
+    VkAccessFlags srcAccess,
+    VkPipelineStageFlags dstStage,
+    VkAccessFlags dstAccess
+) {
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(
+        cmd,
+        srcStage, dstStage,
+        0,
+        1, &barrier,
+        0, nullptr,
+        0, nullptr
+    );
+}
+
+// Rounds size up to the worst case buffer offset alignment.
+VkDeviceSize bufferAlign(VkDeviceSize size) {
+    const VkDeviceSize alignment = 256;
+    return (size + alignment - 1) & ~(alignment - 1);
+}
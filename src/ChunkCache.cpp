@@ -0,0 +1,377 @@
+// NOTE: Packed chunk meshes are kept on disk between runs, so chunks that were
+// generated before are read back instead of triangulated and packed again.
+// The world is split into regions of chunkCacheRegionSize level 0 chunks, each
+// with a file in chunkCacheDirectory that records are only ever appended to.
+// A record is a ChunkCacheRecord followed by the chunk's packed vertices and
+// indices, laid out the same as chunk.staging. Files are memory mapped, and
+// the mapping is remapped when a record past its end is read.
+// Every file starts with a hash of the generator, see chunkCacheHashFile.
+// Files with a different hash are emptied on open, so editing cs.comp or the
+// layout of Params throws away every region.
+// Regions are only opened and looked up by the generate thread. Records are
+// written by whoever finished the chunk and read by the pool, under the
+// region's lock.
+
+const char* chunkCacheDirectory = "cache";
+const u32 chunkCacheMagic = 0x6b6e6843;
+// NOTE: Bump when the CPU mesher or the packed format changes, neither of
+// which the hash sees.
+const u32 chunkCacheVersion = 1;
+const u32 chunkCacheRegionShift = 4;
+const i32 chunkCacheRegionSize = 1 << chunkCacheRegionShift;
+// NOTE: Chunks in new regions aren't cached once this many are open. Must be a
+// power of two.
+const u32 chunkCacheMaxRegions = 1 << 10;
+
+#pragma pack(push, 1)
+struct ChunkCacheHeader {
+    u32 magic;
+    u32 version;
+    u64 hash;
+};
+
+struct ChunkCacheRecord {
+    // NOTE: See chunkCacheKey, never 0.
+    u64 key;
+    u32 vertexCount;
+    u32 indexCount;
+    Vec3 min;
+    Vec3 max;
+};
+#pragma pack(pop)
+
+struct ChunkCacheEntry {
+    ChunkCacheRecord record;
+    // NOTE: Of the record in the file.
+    u64 offset;
+};
+
+struct ChunkCacheRegion {
+    bool open;
+    Vec3i coord;
+    SRWLOCK lock;
+    HANDLE file;
+    HANDLE mapping;
+    u8* view;
+    u64 viewSize;
+    // NOTE: Where the next record is written.
+    u64 size;
+    // NOTE: Open addressing over record.key, 0 marks an empty entry.
+    vector<ChunkCacheEntry> entries;
+    u32 entryCount;
+};
+
+struct ChunkCache {
+    bool enabled;
+    u64 hash;
+    // NOTE: Open addressing over the region coord. Never resized, so the pool
+    // can hold on to ChunkCacheRegion*.
+    vector<ChunkCacheRegion> regions;
+    u32 regionCount;
+    u32 hits;
+    u32 misses;
+    volatile LONG written;
+    volatile LONG64 writtenBytes;
+    // NOTE: Updated by the pool.
+    volatile LONG loaded;
+    volatile LONG64 loadMicroseconds;
+} chunkCache;
+
+u64 chunkCacheHashBytes(u64 hash, void* data, size_t size) {
+    // NOTE: FNV-1a.
+    auto bytes = (u8*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Hashes the contents of the file, or returns 0 if it can't be read.
+u64 chunkCacheHashFile(u64 hash, const char* path) {
+    auto file = openFile(path, "rb");
+    if (!file) return 0;
+    u8 buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        hash = chunkCacheHashBytes(hash, buffer, read);
+    }
+    fclose(file);
+    return hash;
+}
+
+// NOTE: 18 bits per coordinate, which covers far more than a region. The top
+// bit keeps every key non-zero.
+u64 chunkCacheKey(Vec3i& coord, u32 level, u32 transitions) {
+    return (1ull << 63) |
+        ((u64)(level & 7) << 60) |
+        ((u64)(transitions & 0x3f) << 54) |
+        ((u64)(coord.x & 0x3ffff) << 36) |
+        ((u64)(coord.y & 0x3ffff) << 18) |
+        (u64)(coord.z & 0x3ffff);
+}
+
+u64 chunkCacheRecordSize(ChunkCacheRecord& record) {
+    u64 size = sizeof(ChunkCacheRecord) +
+        record.vertexCount * sizeof(PackedVertex) +
+        record.indexCount * sizeof(u16);
+    return (size + 7) & ~7ull;
+}
+
+u32 chunkCacheEntrySlot(ChunkCacheRegion& region, u64 key) {
+    u32 mask = (u32)region.entries.size() - 1;
+    u32 idx = (u32)((key * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+    while (region.entries[idx].record.key &&
+            (region.entries[idx].record.key != key)) {
+        idx = (idx + 1) & mask;
+    }
+    return idx;
+}
+
+// NOTE: A newer record of the same chunk replaces the older one.
+void chunkCacheIndex(ChunkCacheRegion& region, ChunkCacheRecord& record, u64 offset) {
+    if ((region.entryCount + 1) * 2 > region.entries.size()) {
+        vector<ChunkCacheEntry> entries;
+        entries.swap(region.entries);
+        region.entries.resize(entries.size() ? entries.size() * 2 : 64);
+        for (auto& entry: entries) {
+            if (!entry.record.key) continue;
+            region.entries[chunkCacheEntrySlot(region, entry.record.key)] = entry;
+        }
+    }
+    auto& entry = region.entries[chunkCacheEntrySlot(region, record.key)];
+    if (!entry.record.key) region.entryCount++;
+    entry.record = record;
+    entry.offset = offset;
+}
+
+// Maps everything written to the region so far. Needs the exclusive lock once
+// the region is open.
+void chunkCacheMap(ChunkCacheRegion& region) {
+    if (region.view) UnmapViewOfFile(region.view);
+    if (region.mapping) CloseHandle(region.mapping);
+    region.mapping = CreateFileMappingA(region.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CHECK(region.mapping, "could not map chunk cache region");
+    region.view = (u8*)MapViewOfFile(region.mapping, FILE_MAP_READ, 0, 0, 0);
+    CHECK(region.view, "could not map chunk cache region");
+    region.viewSize = region.size;
+}
+
+void chunkCacheTruncate(ChunkCacheRegion& region, u64 size) {
+    LARGE_INTEGER offset;
+    offset.QuadPart = (LONGLONG)size;
+    SetFilePointerEx(region.file, offset, nullptr, FILE_BEGIN);
+    SetEndOfFile(region.file);
+    region.size = size;
+}
+
+bool chunkCacheWriteAt(ChunkCacheRegion& region, u64 offset, void* data, u64 size) {
+    if (!size) return true;
+    LARGE_INTEGER position;
+    position.QuadPart = (LONGLONG)offset;
+    DWORD written = 0;
+    return SetFilePointerEx(region.file, position, nullptr, FILE_BEGIN) &&
+        WriteFile(region.file, data, (DWORD)size, &written, nullptr) &&
+        (written == size);
+}
+
+// Opens the region's file and indexes the records in it. Starts the file over
+// if it was written by a different generator.
+bool chunkCacheLoadRegion(ChunkCacheRegion& region) {
+    char path[MAX_PATH];
+    snprintf(
+        path, sizeof(path),
+        "%s/%d_%d_%d.region",
+        chunkCacheDirectory, region.coord.x, region.coord.y, region.coord.z
+    );
+    region.file = CreateFileA(
+        path,
+        GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr
+    );
+    if (region.file == INVALID_HANDLE_VALUE) {
+        INFO("Could not open chunk cache region %s", path);
+        return false;
+    }
+    InitializeSRWLock(&region.lock);
+
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(region.file, &fileSize);
+    region.size = (u64)fileSize.QuadPart;
+    bool valid = false;
+    if (region.size >= sizeof(ChunkCacheHeader)) {
+        chunkCacheMap(region);
+        auto header = (ChunkCacheHeader*)region.view;
+        valid = (header->magic == chunkCacheMagic) &&
+            (header->version == chunkCacheVersion) &&
+            (header->hash == chunkCache.hash);
+    }
+    if (!valid) {
+        ChunkCacheHeader header = { chunkCacheMagic, chunkCacheVersion, chunkCache.hash };
+        if (region.view) UnmapViewOfFile(region.view);
+        if (region.mapping) CloseHandle(region.mapping);
+        region.view = nullptr;
+        region.mapping = nullptr;
+        chunkCacheTruncate(region, 0);
+        if (!chunkCacheWriteAt(region, 0, &header, sizeof(header))) {
+            CloseHandle(region.file);
+            return false;
+        }
+        region.size = sizeof(header);
+        chunkCacheMap(region);
+        return true;
+    }
+
+    // NOTE: A record cut short by a crash is dropped along with anything after
+    // it.
+    u64 offset = sizeof(ChunkCacheHeader);
+    while (offset + sizeof(ChunkCacheRecord) <= region.size) {
+        auto record = (ChunkCacheRecord*)(region.view + offset);
+        u64 recordSize = chunkCacheRecordSize(*record);
+        if (!record->key || (offset + recordSize > region.size)) break;
+        chunkCacheIndex(region, *record, offset);
+        offset += recordSize;
+    }
+    if (offset != region.size) {
+        UnmapViewOfFile(region.view);
+        CloseHandle(region.mapping);
+        region.view = nullptr;
+        region.mapping = nullptr;
+        chunkCacheTruncate(region, offset);
+        chunkCacheMap(region);
+    }
+    return true;
+}
+
+// Returns the region the chunk is cached in, opening it if needed, or nullptr
+// if it can't be cached.
+ChunkCacheRegion* chunkCacheOpen(Vec3i& coord, u32 level) {
+    if (!chunkCache.enabled) return nullptr;
+    // NOTE: Arithmetic shifts, so negative coordinates round down.
+    i32 scale = 1 << level;
+    Vec3i regionCoord = {
+        (coord.x * scale) >> chunkCacheRegionShift,
+        (coord.y * scale) >> chunkCacheRegionShift,
+        (coord.z * scale) >> chunkCacheRegionShift
+    };
+
+    u32 mask = chunkCacheMaxRegions - 1;
+    u64 hash = chunkCacheKey(regionCoord, 0, 0);
+    u32 idx = (u32)((hash * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+    while (chunkCache.regions[idx].open) {
+        auto& region = chunkCache.regions[idx];
+        if ((region.coord.x == regionCoord.x) &&
+                (region.coord.y == regionCoord.y) &&
+                (region.coord.z == regionCoord.z)) {
+            return &region;
+        }
+        idx = (idx + 1) & mask;
+    }
+    // NOTE: Keep a free entry so the probe above always ends.
+    if (chunkCache.regionCount + 1 >= chunkCacheMaxRegions) return nullptr;
+
+    auto& region = chunkCache.regions[idx];
+    region.coord = regionCoord;
+    if (!chunkCacheLoadRegion(region)) {
+        region = {};
+        return nullptr;
+    }
+    region.open = true;
+    chunkCache.regionCount++;
+    return &region;
+}
+
+bool chunkCacheFind(
+    ChunkCacheRegion& region,
+    u64 key,
+    ChunkCacheRecord& record,
+    u64& offset
+) {
+    AcquireSRWLockShared(&region.lock);
+    bool found = false;
+    if (region.entryCount) {
+        auto& entry = region.entries[chunkCacheEntrySlot(region, key)];
+        if (entry.record.key == key) {
+            record = entry.record;
+            offset = entry.offset;
+            found = true;
+        }
+    }
+    ReleaseSRWLockShared(&region.lock);
+    return found;
+}
+
+// Copies the vertices and indices of the record at offset to dst.
+void chunkCacheRead(
+    ChunkCacheRegion& region,
+    u64 offset,
+    u8* dst,
+    u64 size
+) {
+    u64 start = offset + sizeof(ChunkCacheRecord);
+    AcquireSRWLockShared(&region.lock);
+    if (start + size <= region.viewSize) {
+        memcpy(dst, region.view + start, size);
+        ReleaseSRWLockShared(&region.lock);
+        return;
+    }
+    ReleaseSRWLockShared(&region.lock);
+
+    // NOTE: Written after the region was last mapped.
+    AcquireSRWLockExclusive(&region.lock);
+    if (start + size > region.viewSize) chunkCacheMap(region);
+    memcpy(dst, region.view + start, size);
+    ReleaseSRWLockExclusive(&region.lock);
+}
+
+// Appends a record to the region. The vertex and index counts come from the
+// record.
+void chunkCacheWrite(
+    ChunkCacheRegion& region,
+    ChunkCacheRecord& record,
+    void* vertices,
+    void* indices
+) {
+    u64 vertexSize = record.vertexCount * sizeof(PackedVertex);
+    u64 indexSize = record.indexCount * sizeof(u16);
+    u64 recordSize = chunkCacheRecordSize(record);
+    u64 padding = 0;
+
+    AcquireSRWLockExclusive(&region.lock);
+    u64 offset = region.size;
+    u64 end = offset + sizeof(record) + vertexSize + indexSize;
+    bool written = chunkCacheWriteAt(region, offset, &record, sizeof(record)) &&
+        chunkCacheWriteAt(region, offset + sizeof(record), vertices, vertexSize) &&
+        chunkCacheWriteAt(region, offset + sizeof(record) + vertexSize, indices, indexSize) &&
+        chunkCacheWriteAt(region, end, &padding, offset + recordSize - end);
+    if (written) {
+        region.size = offset + recordSize;
+        chunkCacheIndex(region, record, offset);
+    } else {
+        chunkCacheTruncate(region, offset);
+    }
+    ReleaseSRWLockExclusive(&region.lock);
+
+    if (written) {
+        InterlockedIncrement(&chunkCache.written);
+        InterlockedAdd64(&chunkCache.writtenBytes, (LONG64)recordSize);
+    }
+}
+
+// The hash should cover everything the cached meshes depend on.
+void initChunkCache(u64 hash, bool enabled) {
+    chunkCache.hash = hash;
+    chunkCache.enabled = enabled && hash;
+    if (!chunkCache.enabled) return;
+    if (!CreateDirectoryA(chunkCacheDirectory, nullptr) &&
+            (GetLastError() != ERROR_ALREADY_EXISTS)) {
+        INFO("Could not create chunk cache directory, chunks won't be cached");
+        chunkCache.enabled = false;
+        return;
+    }
+    chunkCache.regions.resize(chunkCacheMaxRegions);
+}
@@ -0,0 +1,217 @@
+// NOTE: Open addressing hash map from chunk coordinate, level and transitions
+// to chunk, with linear probing. Removal shifts the following entries back
+// instead of leaving tombstones, so lookups never get slower as chunks come
+// and go. Only touched by the render thread.
+
+struct ChunkMapEntry {
+    Vec3i coord;
+    u32 level;
+    u32 transitions;
+    // NOTE: nullptr marks an empty entry.
+    Chunk* chunk;
+};
+
+struct ChunkMap {
+    vector<ChunkMapEntry> entries;
+    u32 mask;
+    u32 count;
+    u64 lookups;
+    u64 probes;
+} chunkMap;
+
+// NOTE: Leaves out the transitions, so every version of a chunk lands in the
+// same probe run and chunkMapFindResident can find them all.
+u32 chunkMapHash(Vec3i& coord, u32 level) {
+    u32 hash = ((u32)coord.x * 73856093u) ^
+        ((u32)coord.y * 19349663u) ^
+        ((u32)coord.z * 83492791u) ^
+        (level * 2654435761u);
+    // NOTE: Neighbouring chunks differ in the low bits of one coordinate, mix
+    // them into the bits that pick the bucket.
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+inline bool chunkMapMatches(
+    ChunkMapEntry& entry,
+    Vec3i& coord,
+    u32 level,
+    u32 transitions
+) {
+    return vectorEquals(entry.coord, coord) &&
+        (entry.level == level) &&
+        (entry.transitions == transitions);
+}
+
+Chunk* chunkMapFind(Vec3i coord, u32 level, u32 transitions) {
+    auto& map = chunkMap;
+    map.lookups++;
+    u32 idx = chunkMapHash(coord, level) & map.mask;
+    while (true) {
+        map.probes++;
+        auto& entry = map.entries[idx];
+        if (!entry.chunk) return nullptr;
+        if (chunkMapMatches(entry, coord, level, transitions)) return entry.chunk;
+        idx = (idx + 1) & map.mask;
+    }
+}
+
+// Finds a resident chunk at the coordinate and level, whatever its
+// transitions. Used to draw something while the right one is generated.
+Chunk* chunkMapFindResident(Vec3i coord, u32 level) {
+    auto& map = chunkMap;
+    map.lookups++;
+    u32 idx = chunkMapHash(coord, level) & map.mask;
+    while (true) {
+        map.probes++;
+        auto& entry = map.entries[idx];
+        if (!entry.chunk) return nullptr;
+        if (vectorEquals(entry.coord, coord) &&
+                (entry.level == level) &&
+                (entry.chunk->state == CHUNK_RESIDENT)) {
+            return entry.chunk;
+        }
+        idx = (idx + 1) & map.mask;
+    }
+}
+
+void chunkMapInsert(Chunk* chunk) {
+    auto& map = chunkMap;
+    CHECK(map.count < map.mask, "chunk map full");
+    u32 idx = chunkMapHash(chunk->coord, chunk->level) & map.mask;
+    while (map.entries[idx].chunk) {
+        auto& entry = map.entries[idx];
+        if (chunkMapMatches(entry, chunk->coord, chunk->level, chunk->transitions)) {
+            entry.chunk = chunk;
+            return;
+        }
+        idx = (idx + 1) & map.mask;
+    }
+    map.entries[idx] = { chunk->coord, chunk->level, chunk->transitions, chunk };
+    map.count++;
+}
+
+void chunkMapRemove(Chunk* chunk) {
+    auto& map = chunkMap;
+    u32 idx = chunkMapHash(chunk->coord, chunk->level) & map.mask;
+    while (true) {
+        auto& entry = map.entries[idx];
+        if (!entry.chunk) return;
+        if (chunkMapMatches(entry, chunk->coord, chunk->level, chunk->transitions)) break;
+        idx = (idx + 1) & map.mask;
+    }
+
+    // NOTE: Move later entries of the probe sequence into the hole unless
+    // that would put them before their home bucket.
+    u32 hole = idx;
+    u32 next = (hole + 1) & map.mask;
+    while (map.entries[next].chunk) {
+        auto& entry = map.entries[next];
+        u32 home = chunkMapHash(entry.coord, entry.level) & map.mask;
+        u32 distanceToHole = (hole - home) & map.mask;
+        u32 distanceToNext = (next - home) & map.mask;
+        if (distanceToHole < distanceToNext) {
+            map.entries[hole] = map.entries[next];
+            hole = next;
+        }
+        next = (next + 1) & map.mask;
+    }
+    map.entries[hole] = {};
+    map.count--;
+}
+
+void initChunkMap(u32 chunkCount) {
+    // NOTE: Keep the load factor at or below a half.
+    u32 size = 1;
+    while (size < chunkCount * 2) size <<= 1;
+    chunkMap.entries.resize(size);
+    chunkMap.mask = size - 1;
+}
+
+// Runs random inserts, removes and lookups against the map and a linear scan
+// over the same chunks, and logs any disagreement. Uses its own chunks and
+// leaves the map empty, so run it before initResidency. Run with
+// -chunk-map-check.
+void chunkMapCheck() {
+    const u32 chunkCount = 1024;
+    const u32 operations = 1 << 16;
+    // NOTE: A small world, so inserts often hit coordinates that are taken
+    // and lookups often find something.
+    const i32 coordRange = 16;
+
+    vector<Chunk> chunks(chunkCount);
+    vector<bool> inserted(chunkCount);
+    initChunkMap(chunkCount);
+
+    u32 seed = 0x2545f491;
+    auto random = [&seed](u32 range) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed % range;
+    };
+    auto randomize = [&](Chunk& chunk) {
+        chunk.coord = {
+            (i32)random(coordRange) - coordRange / 2,
+            (i32)random(coordRange) - coordRange / 2,
+            (i32)random(coordRange) - coordRange / 2
+        };
+        chunk.level = random(2);
+        chunk.transitions = random(2) ? 0 : CHUNK_FACE_POS_X;
+        chunk.state = random(2) ? CHUNK_RESIDENT : CHUNK_PENDING;
+    };
+
+    u32 mismatches = 0;
+    for (u32 op = 0; op < operations; op++) {
+        u32 idx = random(chunkCount);
+        auto& chunk = chunks[idx];
+        if (!inserted[idx]) {
+            // NOTE: Callers never insert a key that is already in the map.
+            randomize(chunk);
+            bool taken = false;
+            for (u32 i = 0; i < chunkCount; i++) {
+                taken |= inserted[i] &&
+                    vectorEquals(chunks[i].coord, chunk.coord) &&
+                    (chunks[i].level == chunk.level) &&
+                    (chunks[i].transitions == chunk.transitions);
+            }
+            if (taken) continue;
+            chunkMapInsert(&chunk);
+            inserted[idx] = true;
+        } else if (random(2)) {
+            chunkMapRemove(&chunk);
+            inserted[idx] = false;
+        }
+
+        Chunk probe;
+        randomize(probe);
+        Chunk* expected = nullptr;
+        bool residentExpected = false;
+        for (u32 i = 0; i < chunkCount; i++) {
+            if (!inserted[i]) continue;
+            auto& other = chunks[i];
+            if (!vectorEquals(other.coord, probe.coord) || (other.level != probe.level)) {
+                continue;
+            }
+            if (other.transitions == probe.transitions) expected = &other;
+            residentExpected |= (other.state == CHUNK_RESIDENT);
+        }
+        if (chunkMapFind(probe.coord, probe.level, probe.transitions) != expected) {
+            mismatches++;
+        }
+        auto resident = chunkMapFindResident(probe.coord, probe.level);
+        if ((resident != nullptr) != residentExpected) mismatches++;
+        if (resident && (resident->state != CHUNK_RESIDENT)) mismatches++;
+    }
+
+    u32 count = 0;
+    for (u32 i = 0; i < chunkCount; i++) count += inserted[i];
+    if (count != chunkMap.count) mismatches++;
+    INFO(
+        "Chunk map check: %d operations, %.2f probes per lookup, %d mismatches",
+        operations, (float)chunkMap.probes / chunkMap.lookups, mismatches
+    );
+    chunkMap = {};
+}
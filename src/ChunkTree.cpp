@@ -0,0 +1,297 @@
+// NOTE: Sparse octree over the coordinates of drawn chunks, so culling can
+// throw away or accept whole regions of chunks with one test. Each root
+// covers chunkTreeRootSize level 0 chunks along each axis and only exists
+// while it holds a chunk, same for every node below it. A chunk sits on the
+// node of its own level of detail, which covers the same space. Lod.cpp
+// inserts the chunks it picks to draw and removes them when it stops drawing
+// them, so they never overlap. Empty chunks are left out.
+// Only touched by the render thread.
+
+const u32 chunkTreeLevels = 4;
+const i32 chunkTreeRootSize = 1 << chunkTreeLevels;
+// NOTE: Meshes may poke slightly out of their chunk, so node bounds are
+// padded by this much.
+const float chunkTreeMargin = 1.f;
+
+struct ChunkTreeNode {
+    // NOTE: In units of the node's size, so a node covers chunk coordinates
+    // coord << level up to (coord + 1) << level.
+    Vec3i coord;
+    u32 level;
+    u32 chunkCount;
+    // NOTE: -1 where there is no child.
+    i32 children[8];
+    // NOTE: Only set on nodes holding a chunk of their level, which have no
+    // children.
+    Chunk* chunk;
+};
+
+struct ChunkTree {
+    vector<ChunkTreeNode> nodes;
+    vector<u32> freeNodes;
+    vector<u32> roots;
+    // NOTE: Per cull, for the overlay.
+    u32 nodesVisited;
+    u32 nodesAccepted;
+} chunkTree;
+
+enum ChunkTreeClass {
+    CHUNK_TREE_OUTSIDE,
+    CHUNK_TREE_INTERSECTING,
+    CHUNK_TREE_INSIDE,
+};
+
+u32 chunkTreeAllocate(Vec3i coord, u32 level) {
+    u32 idx;
+    if (chunkTree.freeNodes.empty()) {
+        idx = (u32)chunkTree.nodes.size();
+        chunkTree.nodes.push_back({});
+    } else {
+        idx = chunkTree.freeNodes.back();
+        chunkTree.freeNodes.pop_back();
+    }
+    auto& node = chunkTree.nodes[idx];
+    node = {};
+    node.coord = coord;
+    node.level = level;
+    for (auto& child: node.children) child = -1;
+    return idx;
+}
+
+Vec3i chunkTreeCoord(Vec3i& chunkCoord, u32 level) {
+    // NOTE: Arithmetic shifts, so negative coordinates round down.
+    return {
+        chunkCoord.x >> level,
+        chunkCoord.y >> level,
+        chunkCoord.z >> level
+    };
+}
+
+u32 chunkTreeChildIdx(Vec3i& chunkCoord, u32 level) {
+    u32 shift = level - 1;
+    return ((chunkCoord.x >> shift) & 1) |
+        (((chunkCoord.y >> shift) & 1) << 1) |
+        (((chunkCoord.z >> shift) & 1) << 2);
+}
+
+void chunkTreeInsert(Chunk* chunk) {
+    Vec3i base = chunkBaseCoord(*chunk);
+    Vec3i rootCoord = chunkTreeCoord(base, chunkTreeLevels);
+    i32 idx = -1;
+    for (auto root: chunkTree.roots) {
+        auto& coord = chunkTree.nodes[root].coord;
+        if ((coord.x == rootCoord.x) &&
+                (coord.y == rootCoord.y) &&
+                (coord.z == rootCoord.z)) {
+            idx = root;
+            break;
+        }
+    }
+    if (idx < 0) {
+        idx = chunkTreeAllocate(rootCoord, chunkTreeLevels);
+        chunkTree.roots.push_back(idx);
+    }
+
+    for (u32 level = chunkTreeLevels; level > chunk->level; level--) {
+        chunkTree.nodes[idx].chunkCount++;
+        u32 childIdx = chunkTreeChildIdx(base, level);
+        i32 child = chunkTree.nodes[idx].children[childIdx];
+        if (child < 0) {
+            // NOTE: May reallocate nodes, so only hold on to indices.
+            child = chunkTreeAllocate(chunkTreeCoord(base, level - 1), level - 1);
+            chunkTree.nodes[idx].children[childIdx] = child;
+        }
+        idx = child;
+    }
+    auto& leaf = chunkTree.nodes[idx];
+    CHECK(!leaf.chunk && !leaf.chunkCount, "chunk overlaps the chunk tree");
+    leaf.chunkCount = 1;
+    leaf.chunk = chunk;
+}
+
+void chunkTreeRemove(Chunk* chunk) {
+    Vec3i base = chunkBaseCoord(*chunk);
+    Vec3i rootCoord = chunkTreeCoord(base, chunkTreeLevels);
+    u32 rootSlot = 0;
+    for (; rootSlot < chunkTree.roots.size(); rootSlot++) {
+        auto& coord = chunkTree.nodes[chunkTree.roots[rootSlot]].coord;
+        if ((coord.x == rootCoord.x) &&
+                (coord.y == rootCoord.y) &&
+                (coord.z == rootCoord.z)) {
+            break;
+        }
+    }
+    if (rootSlot == chunkTree.roots.size()) return;
+
+    // NOTE: Walk down first, since a chunk that was never inserted must not
+    // change any counts.
+    u32 path[chunkTreeLevels + 1];
+    path[chunkTreeLevels] = chunkTree.roots[rootSlot];
+    for (u32 level = chunkTreeLevels; level > chunk->level; level--) {
+        auto& node = chunkTree.nodes[path[level]];
+        i32 child = node.children[chunkTreeChildIdx(base, level)];
+        if (child < 0) return;
+        path[level - 1] = child;
+    }
+    if (chunkTree.nodes[path[chunk->level]].chunk != chunk) return;
+    chunkTree.nodes[path[chunk->level]].chunk = nullptr;
+
+    for (u32 level = chunk->level; level <= chunkTreeLevels; level++) {
+        auto& node = chunkTree.nodes[path[level]];
+        node.chunkCount--;
+        if (node.chunkCount) continue;
+        chunkTree.freeNodes.push_back(path[level]);
+        if (level < chunkTreeLevels) {
+            auto& parent = chunkTree.nodes[path[level + 1]];
+            parent.children[chunkTreeChildIdx(base, level + 1)] = -1;
+        } else {
+            chunkTree.roots[rootSlot] = chunkTree.roots.back();
+            chunkTree.roots.pop_back();
+        }
+    }
+}
+
+void chunkTreeBounds(ChunkTreeNode& node, Vec3& min, Vec3& max) {
+    float size = (float)(computeWidth << node.level);
+    min = {
+        node.coord.x * size - chunkTreeMargin,
+        node.coord.y * size - chunkTreeMargin,
+        node.coord.z * size - chunkTreeMargin
+    };
+    max = {
+        min.x + size + 2 * chunkTreeMargin,
+        min.y + size + 2 * chunkTreeMargin,
+        min.z + size + 2 * chunkTreeMargin
+    };
+}
+
+// Tests the box against the planes whose bit is set in planeMask, clearing the
+// bits of planes the box is entirely inside of.
+ChunkTreeClass chunkTreeClassify(
+    Vec3& min,
+    Vec3& max,
+    Vec4* planes,
+    u32& planeMask
+) {
+    for (u32 i = 0; i < cullPlaneCount; i++) {
+        if (!(planeMask & (1 << i))) continue;
+        auto& plane = planes[i];
+        // NOTE: The corners furthest along and against the normal.
+        Vec3 p = {
+            (plane.x >= 0) ? max.x : min.x,
+            (plane.y >= 0) ? max.y : min.y,
+            (plane.z >= 0) ? max.z : min.z
+        };
+        Vec3 n = {
+            (plane.x >= 0) ? min.x : max.x,
+            (plane.y >= 0) ? min.y : max.y,
+            (plane.z >= 0) ? min.z : max.z
+        };
+        if (plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w < 0) {
+            return CHUNK_TREE_OUTSIDE;
+        }
+        if (plane.x * n.x + plane.y * n.y + plane.z * n.z + plane.w >= 0) {
+            planeMask &= ~(1 << i);
+        }
+    }
+    return planeMask ? CHUNK_TREE_INTERSECTING : CHUNK_TREE_INSIDE;
+}
+
+// Classifies the box against a sphere of radius drawDistance around the eye.
+ChunkTreeClass chunkTreeClassifyDistance(
+    Vec3& min,
+    Vec3& max,
+    Vec4& eye,
+    float drawDistance
+) {
+    float e[3] = { eye.x, eye.y, eye.z };
+    float lo[3] = { min.x, min.y, min.z };
+    float hi[3] = { max.x, max.y, max.z };
+    float nearest = 0;
+    float furthest = 0;
+    for (u32 i = 0; i < 3; i++) {
+        float below = lo[i] - e[i];
+        float above = e[i] - hi[i];
+        float d = fmaxf(fmaxf(below, above), 0.f);
+        nearest += d * d;
+        float f = fmaxf(fabsf(e[i] - lo[i]), fabsf(e[i] - hi[i]));
+        furthest += f * f;
+    }
+    float limit = drawDistance * drawDistance;
+    if (nearest > limit) return CHUNK_TREE_OUTSIDE;
+    if (furthest <= limit) return CHUNK_TREE_INSIDE;
+    return CHUNK_TREE_INTERSECTING;
+}
+
+void chunkTreeCollect(u32 idx, vector<Chunk*>& chunks) {
+    auto& node = chunkTree.nodes[idx];
+    if (node.chunk) {
+        chunks.push_back(node.chunk);
+        return;
+    }
+    for (auto child: node.children) {
+        if (child >= 0) chunkTreeCollect(child, chunks);
+    }
+}
+
+void chunkTreeVisit(
+    u32 idx,
+    Vec4* planes,
+    u32 planeMask,
+    Vec4& eye,
+    float drawDistance,
+    vector<Chunk*>& chunks
+) {
+    chunkTree.nodesVisited++;
+    auto& node = chunkTree.nodes[idx];
+    Vec3 min;
+    Vec3 max;
+    if (node.chunk) {
+        min = node.chunk->min;
+        max = node.chunk->max;
+    } else {
+        chunkTreeBounds(node, min, max);
+    }
+
+    bool inRange = true;
+    if (drawDistance > 0) {
+        auto distanceClass = chunkTreeClassifyDistance(min, max, eye, drawDistance);
+        if (distanceClass == CHUNK_TREE_OUTSIDE) return;
+        inRange = distanceClass == CHUNK_TREE_INSIDE;
+    }
+    if (chunkTreeClassify(min, max, planes, planeMask) == CHUNK_TREE_OUTSIDE) return;
+
+    // NOTE: Everything below is in view and in range, and the leaves are
+    // still tested on their own by drawListCull.
+    if (node.chunk || (!planeMask && inRange)) {
+        if (!node.chunk) chunkTree.nodesAccepted++;
+        chunkTreeCollect(idx, chunks);
+        return;
+    }
+    for (auto child: node.children) {
+        if (child < 0) continue;
+        chunkTreeVisit(child, planes, planeMask, eye, drawDistance, chunks);
+    }
+}
+
+// Appends every chunk that may be in view and within drawDistance of the eye
+// to chunks. A drawDistance of 0 draws everything in view.
+void chunkTreeCull(
+    Vec4* planes,
+    Vec4& eye,
+    float drawDistance,
+    vector<Chunk*>& chunks
+) {
+    chunkTree.nodesVisited = 0;
+    chunkTree.nodesAccepted = 0;
+    for (auto root: chunkTree.roots) {
+        chunkTreeVisit(
+            root,
+            planes,
+            (1 << cullPlaneCount) - 1,
+            eye,
+            drawDistance,
+            chunks
+        );
+    }
+}
@@ -0,0 +1,49 @@
+#include <intrin.h>
+#include <immintrin.h>
+
+struct CpuFeatures {
+    bool sse41;
+    bool avx2;
+    bool avx512f;
+    u32 coreCount;
+} cpu;
+
+void initCpu() {
+    int info[4] = {};
+
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    cpu.sse41 = (info[2] & (1 << 19)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+
+    // NOTE: The OS has to save the YMM/ZMM registers on a context switch,
+    // otherwise AVX instructions fault even though CPUID reports them.
+    bool ymmEnabled = false;
+    bool zmmEnabled = false;
+    if (osxsave && avx) {
+        auto xcr0 = _xgetbv(0);
+        ymmEnabled = (xcr0 & 0x6) == 0x6;
+        zmmEnabled = (xcr0 & 0xe6) == 0xe6;
+    }
+
+    if (maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        cpu.avx2 = ymmEnabled && ((info[1] & (1 << 5)) != 0);
+        cpu.avx512f = zmmEnabled && ((info[1] & (1 << 16)) != 0);
+    }
+
+    SYSTEM_INFO systemInfo = {};
+    GetSystemInfo(&systemInfo);
+    cpu.coreCount = systemInfo.dwNumberOfProcessors;
+
+    INFO(
+        "CPU: %d cores, SSE4.1 %s, AVX2 %s, AVX-512 %s",
+        cpu.coreCount,
+        cpu.sse41 ? "yes" : "no",
+        cpu.avx2 ? "yes" : "no",
+        cpu.avx512f ? "yes" : "no"
+    );
+}
@@ -0,0 +1,608 @@
+// NOTE: CPU implementation of shaders/cs.comp. meshTriangulate writes
+// meshVerticesPerCell vertex slots per cell, with the unused slots zeroed, and
+// chunkPack compacts them and welds the result (see meshWeld) into the same
+// indexed mesh the compute shader produces.
+
+const u32 meshVerticesPerCell = 15;
+const u32 meshBatchWidth = 8;
+
+// Density at every lattice corner of a chunk. Cell corners extend to y - 1
+// (see vertexOffsets), so cell (x, y, z) reads lattice rows y and y + 1.
+struct MeshLattice {
+    u32 width;
+    u32 height;
+    u32 depth;
+    // NOTE: The position of the first corner, w is the width of a cell.
+    Vec4 origin;
+    // NOTE: ChunkFace bits, see transitions in cs.comp.
+    u32 transitions;
+    vector<float> densities;
+};
+
+thread_local MeshLattice meshLattice;
+
+inline float* meshLatticeRow(MeshLattice& lattice, u32 y, u32 z) {
+    return lattice.densities.data() + (y * lattice.depth + z) * lattice.width;
+}
+
+inline float& meshLatticeDensity(MeshLattice& lattice, u32* p) {
+    return meshLatticeRow(lattice, p[1], p[2])[p[0]];
+}
+
+float meshTransitionCenter(float* corners) {
+    return (corners[0] + corners[1] + corners[2] + corners[3]) * .25f;
+}
+
+// Returns the ChunkFace bits of the transition faces the edge from a to b lies
+// on. Edges along the chunk's edges can lie on two.
+u32 meshTransitionFaces(MeshLattice& lattice, u32* a, u32* b) {
+    u32 size[3] = { lattice.width - 1, lattice.height - 1, lattice.depth - 1 };
+    u32 faces = 0;
+    for (u32 axis = 0; axis < 3; axis++) {
+        if ((a[axis] == 0) && (b[axis] == 0)) {
+            faces |= 1 << (axis * 2);
+        } else if ((a[axis] == size[axis]) && (b[axis] == size[axis])) {
+            faces |= 1 << (axis * 2 + 1);
+        }
+    }
+    return faces & lattice.transitions;
+}
+
+// Same as transitionCoarseCase in cs.comp.
+u32 meshTransitionCoarseCase(MeshLattice& lattice, u32* q, u32 face) {
+    u32 axis = face / 2;
+    i32 origin[3] = { (i32)q[0], (i32)q[1], (i32)q[2] };
+    if (!(face & 1)) origin[axis] -= 2;
+    u32 caseIdx = 0;
+    for (u32 i = 0; i < 8; i++) {
+        auto& offset = vertexOffsets[i];
+        i32 p[3] = {
+            origin[0] + (i32)offset.x * 2,
+            origin[1] + (1 + (i32)offset.y) * 2,
+            origin[2] + (i32)offset.z * 2
+        };
+        float density;
+        if (p[axis] == (i32)q[axis]) {
+            u32 onFace[3] = { (u32)p[0], (u32)p[1], (u32)p[2] };
+            density = meshLatticeDensity(lattice, onFace);
+        } else {
+            float w = lattice.origin.w;
+            density = noise({
+                (lattice.origin.x + p[0] * w) * (1.f / 16.f),
+                (lattice.origin.y + p[1] * w) * (1.f / 16.f),
+                (lattice.origin.z + p[2] * w) * (1.f / 16.f)
+            });
+        }
+        if (density > isoSurfaceLevel) caseIdx |= 1 << i;
+    }
+    return caseIdx;
+}
+
+// Same as transitionFaceEdge in cs.comp.
+bool meshTransitionFaceEdge(
+    u32 edgeIdx,
+    u32 face,
+    u32 along,
+    u32 across,
+    float* midpoint
+) {
+    u32 axis = face / 2;
+    i32 plane = (face & 1) ? 0 : 1;
+    auto& v0 = vertexOffsets[edgeToVertexIndices[edgeIdx][0]];
+    auto& v1 = vertexOffsets[edgeToVertexIndices[edgeIdx][1]];
+    i32 c0[3] = { (i32)v0.x, 1 + (i32)v0.y, (i32)v0.z };
+    i32 c1[3] = { (i32)v1.x, 1 + (i32)v1.y, (i32)v1.z };
+    if ((c0[axis] != plane) || (c1[axis] != plane)) return false;
+    midpoint[0] = (float)(c0[along] + c1[along]);
+    midpoint[1] = (float)(c0[across] + c1[across]);
+    return true;
+}
+
+// Same as transitionSegments in cs.comp.
+u32 meshTransitionSegments(
+    u32 caseIdx,
+    u32 face,
+    u32 along,
+    u32 across,
+    float (*segments)[4]
+) {
+    auto triangleList = caseIdxToTriangleList[caseIdx];
+    u32 segmentCount = 0;
+    for (u32 t = 0; (t < 15) && (triangleList[t] >= 0); t += 3) {
+        for (u32 k = 0; k < 3; k++) {
+            i32 e0 = triangleList[t + k];
+            i32 e1 = triangleList[t + (k + 1) % 3];
+            float m0[2];
+            float m1[2];
+            if (!meshTransitionFaceEdge(e0, face, along, across, m0)) continue;
+            if (!meshTransitionFaceEdge(e1, face, along, across, m1)) continue;
+            u32 sharedEnds = 0;
+            for (u32 o = 0; (o < 15) && (triangleList[o] >= 0); o += 3) {
+                bool has0 = false;
+                bool has1 = false;
+                for (u32 j = 0; j < 3; j++) {
+                    has0 |= triangleList[o + j] == e0;
+                    has1 |= triangleList[o + j] == e1;
+                }
+                if (has0 && has1) sharedEnds++;
+            }
+            if ((sharedEnds > 1) || (segmentCount == 4)) continue;
+            segments[segmentCount][0] = m0[0];
+            segments[segmentCount][1] = m0[1];
+            segments[segmentCount][2] = m1[0];
+            segments[segmentCount][3] = m1[1];
+            segmentCount++;
+        }
+    }
+    return segmentCount;
+}
+
+// Same as transitionCenterDensity in cs.comp.
+float meshTransitionCenterDensity(
+    MeshLattice& lattice,
+    u32* q,
+    u32 face,
+    u32 u,
+    u32 v,
+    float* corners
+) {
+    float center = meshTransitionCenter(corners);
+    bool inside[4];
+    for (u32 i = 0; i < 4; i++) inside[i] = corners[i] > isoSurfaceLevel;
+    if ((inside[0] != inside[3]) || (inside[1] != inside[2]) || (inside[0] == inside[1])) {
+        return center;
+    }
+
+    u32 caseIdx = meshTransitionCoarseCase(lattice, q, face);
+    float segments[4][4];
+    u32 segmentCount = meshTransitionSegments(caseIdx, face, u, v, segments);
+    bool joined = false;
+    for (u32 i = 0; i < segmentCount; i++) {
+        float* s = segments[i];
+        float x = s[0] + s[2];
+        float y = s[1] + s[3];
+        if (((x == 3.f) && (y == 1.f)) || ((x == 1.f) && (y == 3.f))) joined = true;
+    }
+    bool wanted = joined ? inside[0] : inside[1];
+    if ((center > isoSurfaceLevel) == wanted) return center;
+    return joined ? (corners[0] + corners[3]) * .5f : (corners[1] + corners[2]) * .5f;
+}
+
+// Same as transitionDensities in cs.comp.
+void meshTransitionDensities(MeshLattice& lattice) {
+    u32 p[3];
+    for (p[1] = 0; p[1] < lattice.height; p[1]++) {
+        for (p[2] = 0; p[2] < lattice.depth; p[2]++) {
+            for (p[0] = 0; p[0] < lattice.width; p[0]++) {
+                u32 faces = meshTransitionFaces(lattice, p, p);
+                if (!faces) continue;
+
+                // NOTE: A point on two faces has at most one odd coordinate,
+                // along the edge between them, so either face averages it the
+                // same way.
+                u32 face = 0;
+                while (!(faces & (1 << face))) face++;
+                u32 axis = face / 2;
+                u32 u = (axis + 1) % 3;
+                u32 v = (axis + 2) % 3;
+                bool oddU = p[u] & 1;
+                bool oddV = p[v] & 1;
+                if (!oddU && !oddV) continue;
+                auto neighbour = [&](i32 du, i32 dv) {
+                    u32 q[3] = { p[0], p[1], p[2] };
+                    q[u] += du;
+                    q[v] += dv;
+                    return meshLatticeDensity(lattice, q);
+                };
+                if (oddU && oddV) {
+                    float corners[4] = {
+                        neighbour(-1, -1),
+                        neighbour( 1, -1),
+                        neighbour(-1,  1),
+                        neighbour( 1,  1)
+                    };
+                    u32 q[3] = { p[0], p[1], p[2] };
+                    q[u]--;
+                    q[v]--;
+                    meshLatticeDensity(lattice, p) =
+                        meshTransitionCenterDensity(lattice, q, face, u, v, corners);
+                } else if (oddU) {
+                    meshLatticeDensity(lattice, p) = (neighbour(-1, 0) + neighbour(1, 0)) * .5f;
+                } else {
+                    meshLatticeDensity(lattice, p) = (neighbour(0, -1) + neighbour(0, 1)) * .5f;
+                }
+            }
+        }
+    }
+}
+
+// Returns false if every density is on the same side of the iso surface, in
+// which case no cell has a triangle and there is nothing to triangulate.
+bool meshSampleLattice(
+    MeshLattice& lattice,
+    Vec4& baseOffset,
+    Vec4i& dimensions,
+    u32 transitions
+) {
+    lattice.width = dimensions.x + 1;
+    lattice.height = dimensions.y + 1;
+    lattice.depth = dimensions.z + 1;
+    lattice.densities.resize(lattice.width * lattice.height * lattice.depth);
+    lattice.origin = {
+        baseOffset.x,
+        baseOffset.y - baseOffset.w,
+        baseOffset.z,
+        baseOffset.w
+    };
+    lattice.transitions = transitions;
+
+    Vec3 origin = { lattice.origin.x, lattice.origin.y, lattice.origin.z };
+    noiseLattice(
+        origin,
+        lattice.origin.w,
+        1.f / 16.f,
+        lattice.width,
+        lattice.height,
+        lattice.depth,
+        lattice.densities.data()
+    );
+
+    // NOTE: Transitions only average densities on the face, which can't
+    // change which side of the surface a uniform lattice is on.
+    bool inside = false;
+    bool outside = false;
+    for (auto density: lattice.densities) {
+        if (density > isoSurfaceLevel) {
+            inside = true;
+        } else {
+            outside = true;
+        }
+    }
+    if (!inside || !outside) return false;
+
+    if (transitions) meshTransitionDensities(lattice);
+    return true;
+}
+
+u32 meshCaseIdx(MeshLattice& lattice, u32 x, u32 y, u32 z) {
+    u32 caseIdx = 0;
+    for (u32 i = 0; i < 8; i++) {
+        auto& offset = vertexOffsets[i];
+        auto row = meshLatticeRow(
+            lattice,
+            y + 1 + (i32)offset.y,
+            z + (u32)offset.z
+        );
+        if (row[x + (u32)offset.x] > isoSurfaceLevel) {
+            caseIdx |= 1 << i;
+        }
+    }
+    return caseIdx;
+}
+
+// Closest point to p on the segment from a to b.
+void meshTransitionProject(float* p, const float* a, const float* b, float* result) {
+    float ab[2] = { b[0] - a[0], b[1] - a[1] };
+    float t = ((p[0] - a[0]) * ab[0] + (p[1] - a[1]) * ab[1]) /
+        (ab[0] * ab[0] + ab[1] * ab[1]);
+    t = (t < 0.f) ? 0.f : ((t > 1.f) ? 1.f : t);
+    result[0] = a[0] + ab[0] * t;
+    result[1] = a[1] + ab[1] * t;
+}
+
+// Same as transitionSnapQuad in cs.comp.
+void meshTransitionSnapQuad(
+    MeshLattice& lattice,
+    float* p,
+    u32* q,
+    u32 face,
+    u32 along,
+    u32 across
+) {
+    u32 caseIdx = meshTransitionCoarseCase(lattice, q, face);
+    float segments[4][4];
+    u32 segmentCount = meshTransitionSegments(caseIdx, face, along, across, segments);
+    float nearest[2] = { p[0], p[1] };
+    float best = 0.f;
+    for (u32 i = 0; i < segmentCount; i++) {
+        float snapped[2];
+        meshTransitionProject(p, segments[i], segments[i] + 2, snapped);
+        float d = (p[0] - snapped[0]) * (p[0] - snapped[0]) +
+            (p[1] - snapped[1]) * (p[1] - snapped[1]);
+        if ((i == 0) || (d < best)) {
+            best = d;
+            nearest[0] = snapped[0];
+            nearest[1] = snapped[1];
+        }
+    }
+    p[0] = nearest[0];
+    p[1] = nearest[1];
+}
+
+// Same as transitionVertex in cs.comp.
+void meshTransitionVertex(MeshLattice& lattice, u32* a, u32* b, float* position) {
+    u32 faces = meshTransitionFaces(lattice, a, b);
+    for (u32 face = 0; face < 6; face++) {
+        if (!(faces & (1 << face))) continue;
+
+        u32 axis = face / 2;
+        u32 along = (a[(axis + 1) % 3] != b[(axis + 1) % 3]) ? (axis + 1) % 3 : (axis + 2) % 3;
+        u32 across = 3 - axis - along;
+        u32 start = ((a[along] < b[along]) ? a[along] : b[along]) & ~1u;
+        if (!(a[across] & 1)) {
+            position[along] = (float)(start + 1);
+            continue;
+        }
+
+        u32 q[3] = { a[0], a[1], a[2] };
+        q[along] = start;
+        q[across] = a[across] - 1;
+        float p[2] = {
+            position[along] - (float)q[along],
+            position[across] - (float)q[across]
+        };
+        meshTransitionSnapQuad(lattice, p, q, face, along, across);
+        position[along] = (float)q[along] + p[0];
+        position[across] = (float)q[across] + p[1];
+    }
+}
+
+void meshEmitCell(
+    MeshLattice& lattice,
+    u32 x, u32 y, u32 z,
+    u32 caseIdx,
+    Vertex* vertices
+) {
+    auto triangleList = caseIdxToTriangleList[caseIdx];
+    u32 vertexIdx = 0;
+    for (u32 triangleIdx = 0; triangleIdx < meshVerticesPerCell / 3; triangleIdx++) {
+        if (triangleList[triangleIdx * 3] < 0) break;
+
+        Vec3 v[3];
+        for (u32 i = 0; i < 3; i++) {
+            u32 edgeIdx = triangleList[triangleIdx * 3 + i];
+            auto& v0 = vertexOffsets[edgeToVertexIndices[edgeIdx][0]];
+            auto& v1 = vertexOffsets[edgeToVertexIndices[edgeIdx][1]];
+            // NOTE: The lattice corners of the edge, see cellCorner in cs.comp.
+            u32 a[3] = { x + (u32)v0.x, y + 1 + (i32)v0.y, z + (u32)v0.z };
+            u32 b[3] = { x + (u32)v1.x, y + 1 + (i32)v1.y, z + (u32)v1.z };
+            float position[3] = {
+                (a[0] + b[0]) / 2.f,
+                (a[1] + b[1]) / 2.f,
+                (a[2] + b[2]) / 2.f
+            };
+            if (lattice.transitions) meshTransitionVertex(lattice, a, b, position);
+            v[i].x = lattice.origin.x + position[0] * lattice.origin.w;
+            v[i].y = lattice.origin.y + position[1] * lattice.origin.w;
+            v[i].z = lattice.origin.z + position[2] * lattice.origin.w;
+        }
+
+        Vec3 a = { v[1].x - v[0].x, v[1].y - v[0].y, v[1].z - v[0].z };
+        Vec3 b = { v[2].x - v[0].x, v[2].y - v[0].y, v[2].z - v[0].z };
+        Vec3 normal = {
+            b.y * a.z - b.z * a.y,
+            b.z * a.x - b.x * a.z,
+            b.x * a.y - b.y * a.x
+        };
+        float length = sqrtf(
+            normal.x * normal.x + normal.y * normal.y + normal.z * normal.z
+        );
+        // NOTE: Snapping on transition faces can flatten triangles.
+        if (length == 0.f) length = 1.f;
+
+        for (u32 i = 0; i < 3; i++) {
+            auto& vertex = vertices[vertexIdx];
+            vertex.position.x = v[i].x;
+            vertex.position.y = v[i].y;
+            vertex.position.z = v[i].z;
+            vertex.position.w = 1.f;
+            vertex.normal.x = normal.x / length;
+            vertex.normal.y = normal.y / length;
+            vertex.normal.z = normal.z / length;
+            vertex.normal.w = 0.f;
+            vertexIdx++;
+        }
+    }
+    memset(
+        vertices + vertexIdx,
+        0,
+        (meshVerticesPerCell - vertexIdx) * sizeof(Vertex)
+    );
+}
+
+// Classifies meshBatchWidth consecutive cells along X at once. Returns a mask
+// with a bit set for each cell that actually intersects the iso surface.
+u32 meshCaseIdxAVX2(
+    MeshLattice& lattice,
+    u32 x, u32 y, u32 z,
+    u32* caseIdx
+) {
+    __m256 iso = _mm256_set1_ps(isoSurfaceLevel);
+    __m256i result = _mm256_setzero_si256();
+    for (u32 i = 0; i < 8; i++) {
+        auto& offset = vertexOffsets[i];
+        auto row = meshLatticeRow(
+            lattice,
+            y + 1 + (i32)offset.y,
+            z + (u32)offset.z
+        );
+        __m256 densities = _mm256_loadu_ps(row + x + (u32)offset.x);
+        __m256i inside = _mm256_castps_si256(
+            _mm256_cmp_ps(densities, iso, _CMP_GT_OQ)
+        );
+        result = _mm256_or_si256(
+            result,
+            _mm256_and_si256(inside, _mm256_set1_epi32(1 << i))
+        );
+    }
+    _mm256_storeu_si256((__m256i*)caseIdx, result);
+
+    // NOTE: Cells that are entirely inside or outside emit no triangles.
+    __m256i empty = _mm256_or_si256(
+        _mm256_cmpeq_epi32(result, _mm256_setzero_si256()),
+        _mm256_cmpeq_epi32(result, _mm256_set1_epi32(0xff))
+    );
+    return ~_mm256_movemask_ps(_mm256_castsi256_ps(empty)) & 0xff;
+}
+
+// Fills vertices from a lattice meshSampleLattice found the surface in.
+void meshTriangulate(
+    MeshLattice& lattice,
+    Vec4i dimensions,
+    Vertex* vertices
+) {
+    for (u32 Y = 0; Y < (u32)dimensions.y; Y++) {
+        for (u32 Z = 0; Z < (u32)dimensions.z; Z++) {
+            auto cellVertices = vertices + (
+                Z * dimensions.z * meshVerticesPerCell +
+                Y * dimensions.x * dimensions.z * meshVerticesPerCell
+            );
+            u32 X = 0;
+            if (cpu.avx2) {
+                for (; X + meshBatchWidth <= (u32)dimensions.x; X += meshBatchWidth) {
+                    u32 caseIdx[meshBatchWidth];
+                    u32 activeMask = meshCaseIdxAVX2(lattice, X, Y, Z, caseIdx);
+                    for (u32 lane = 0; lane < meshBatchWidth; lane++) {
+                        auto dst = cellVertices + (X + lane) * meshVerticesPerCell;
+                        if (activeMask & (1 << lane)) {
+                            meshEmitCell(lattice, X + lane, Y, Z, caseIdx[lane], dst);
+                        } else {
+                            memset(dst, 0, meshVerticesPerCell * sizeof(Vertex));
+                        }
+                    }
+                }
+                _mm256_zeroupper();
+            }
+            for (; X < (u32)dimensions.x; X++) {
+                u32 caseIdx = meshCaseIdx(lattice, X, Y, Z);
+                meshEmitCell(
+                    lattice,
+                    X, Y, Z,
+                    caseIdx,
+                    cellVertices + X * meshVerticesPerCell
+                );
+            }
+        }
+    }
+}
+
+// NOTE: Vertices sharing an edge are computed the same way, so they have
+// exactly the same position. Positions are welded in 1 / meshWeldScale of a
+// cell, the precision they are packed with (see packPositionScale), since
+// vertices snapped onto transition faces are off the edge midpoints. A chunk
+// has at most computeEdgeCount distinct vertices, so the table is kept under
+// half full.
+const u32 meshWeldTableSize = 1 << 15;
+const float meshWeldScale = 1024.f;
+
+struct MeshWeldEntry {
+    i32 x;
+    i32 y;
+    i32 z;
+    u32 generation;
+    u16 index;
+};
+
+struct MeshWeldTable {
+    vector<MeshWeldEntry> entries;
+    // NOTE: Entries stamped with an older generation are empty, so the table
+    // doesn't have to be cleared between chunks.
+    u32 generation;
+};
+
+thread_local MeshWeldTable meshWeldTable;
+
+// Merges the vertices of a triangle soup that share a position. The unique
+// vertices are moved to the front of vertices and one index per input vertex
+// is written to indices. Returns the number of unique vertices.
+u32 meshWeld(Vertex* vertices, u32 vertexCount, float cellSize, u16* indices) {
+    auto& table = meshWeldTable;
+    if (table.entries.empty()) {
+        table.entries.resize(meshWeldTableSize);
+    }
+    table.generation++;
+
+    float scale = meshWeldScale / cellSize;
+    u32 weldedCount = 0;
+    for (u32 i = 0; i < vertexCount; i++) {
+        auto& position = vertices[i].position;
+        i32 x = (i32)roundf(position.x * scale);
+        i32 y = (i32)roundf(position.y * scale);
+        i32 z = (i32)roundf(position.z * scale);
+
+        u32 hash = ((u32)x * 73856093u) ^ ((u32)y * 19349663u) ^ ((u32)z * 83492791u);
+        u32 slot = hash & (meshWeldTableSize - 1);
+        while (true) {
+            auto& entry = table.entries[slot];
+            if (entry.generation != table.generation) {
+                entry = { x, y, z, table.generation, (u16)weldedCount };
+                // NOTE: weldedCount <= i, so this never overwrites a vertex
+                // that hasn't been read yet.
+                vertices[weldedCount] = vertices[i];
+                indices[i] = (u16)weldedCount;
+                weldedCount++;
+                break;
+            }
+            if ((entry.x == x) && (entry.y == y) && (entry.z == z)) {
+                indices[i] = entry.index;
+                break;
+            }
+            slot = (slot + 1) & (meshWeldTableSize - 1);
+        }
+    }
+    return weldedCount;
+}
+
+thread_local NoisePoints meshGradientPoints;
+thread_local vector<float> meshGradientDensities;
+
+// Replaces the face normals of welded vertices with the normalized density
+// gradient, sampled the same way as densityGradient in cs.comp.
+void meshSmoothNormals(Vertex* vertices, u32 vertexCount) {
+    const float e = 0.1f;
+    const float scale = 1.f / 16.f;
+    const Vec3 offsets[6] = {
+        {  e, 0, 0 }, { -e, 0, 0 },
+        { 0,  e, 0 }, { 0, -e, 0 },
+        { 0, 0,  e }, { 0, 0, -e },
+    };
+
+    auto& points = meshGradientPoints;
+    auto& densities = meshGradientDensities;
+    u32 count = vertexCount * 6;
+    points.x.resize(count);
+    points.y.resize(count);
+    points.z.resize(count);
+    densities.resize(count);
+
+    for (u32 i = 0; i < vertexCount; i++) {
+        auto& position = vertices[i].position;
+        for (u32 j = 0; j < 6; j++) {
+            points.x[i * 6 + j] = (position.x + offsets[j].x) * scale;
+            points.y[i * 6 + j] = (position.y + offsets[j].y) * scale;
+            points.z[i * 6 + j] = (position.z + offsets[j].z) * scale;
+        }
+    }
+    noiseBatch(
+        points.x.data(),
+        points.y.data(),
+        points.z.data(),
+        count,
+        densities.data()
+    );
+
+    for (u32 i = 0; i < vertexCount; i++) {
+        auto d = densities.data() + i * 6;
+        Vec3 gradient = { d[0] - d[1], d[2] - d[3], d[4] - d[5] };
+        float length = sqrtf(
+            gradient.x * gradient.x +
+            gradient.y * gradient.y +
+            gradient.z * gradient.z
+        );
+        // NOTE: Keep the face normal in the (unlikely) case of a flat spot.
+        if (length == 0.f) continue;
+        vertices[i].normal.x = gradient.x / length;
+        vertices[i].normal.y = gradient.y / length;
+        vertices[i].normal.z = gradient.z / length;
+    }
+}
@@ -0,0 +1,323 @@
+// NOTE: Frustum culling of chunk AABBs on the CPU, for devices where the cull
+// pass in shaders/cull.comp is not wanted (see -no-gpu-cull) and as a reference
+// for it. Bounds are kept as structure of arrays so the AVX2 path can test
+// cullBatchWidth boxes against a plane with a handful of instructions. Both
+// paths use the p-vertex test: a box is culled only if the corner furthest
+// along a plane's normal is behind it, so nothing visible is ever culled.
+
+const u32 cullPlaneCount = 6;
+const u32 cullBatchWidth = 8;
+
+// NOTE: Padded to a multiple of cullBatchWidth.
+struct CullBounds {
+    vector<float> minX;
+    vector<float> minY;
+    vector<float> minZ;
+    vector<float> maxX;
+    vector<float> maxY;
+    vector<float> maxZ;
+    u32 count;
+};
+
+void cullBoundsResize(CullBounds& bounds, u32 count) {
+    u32 padded = (count + cullBatchWidth - 1) & ~(cullBatchWidth - 1);
+    bounds.minX.resize(padded);
+    bounds.minY.resize(padded);
+    bounds.minZ.resize(padded);
+    bounds.maxX.resize(padded);
+    bounds.maxY.resize(padded);
+    bounds.maxZ.resize(padded);
+    bounds.count = count;
+}
+
+void cullBoundsSet(CullBounds& bounds, u32 i, Vec3& min, Vec3& max) {
+    bounds.minX[i] = min.x;
+    bounds.minY[i] = min.y;
+    bounds.minZ[i] = min.z;
+    bounds.maxX[i] = max.x;
+    bounds.maxY[i] = max.y;
+    bounds.maxZ[i] = max.z;
+}
+
+// Turns the view into world space planes, with the inside where
+// dot(plane.xyz, p) + plane.w >= 0. In clip space these are -w <= x <= w,
+// -w <= y <= w and 0 <= z <= w, the volume the rasterizer keeps.
+void cullFrustumPlanes(
+    float* proj,
+    Vec4& eye,
+    Quaternion& rotation,
+    Vec4* planes
+) {
+    // NOTE: Recover the projection from what it does to the origin and the
+    // axes, rather than depending on how the matrix is laid out.
+    Vec3 points[4] = {
+        { 1, 0, 0 },
+        { 0, 1, 0 },
+        { 0, 0, 1 },
+        { 0, 0, 0 }
+    };
+    Vec4 columns[4] = {};
+    for (u32 i = 0; i < 4; i++) {
+        matrixMultiplyPoint(proj, points[i], columns[i]);
+    }
+    for (u32 i = 0; i < 3; i++) {
+        columns[i].x -= columns[3].x;
+        columns[i].y -= columns[3].y;
+        columns[i].z -= columns[3].z;
+        columns[i].w -= columns[3].w;
+    }
+
+    // NOTE: Clip space coefficients, with (nx, ny, nz, d) taken from each
+    // column's x, y, z or w.
+    float signs[cullPlaneCount][4] = {
+        {  1,  0,  0, 1 },
+        { -1,  0,  0, 1 },
+        {  0,  1,  0, 1 },
+        {  0, -1,  0, 1 },
+        {  0,  0,  1, 0 },
+        {  0,  0, -1, 1 }
+    };
+    Quaternion inverse = rotation;
+    inverse.x = -rotation.x;
+    inverse.y = -rotation.y;
+    inverse.z = -rotation.z;
+    for (u32 i = 0; i < cullPlaneCount; i++) {
+        auto s = signs[i];
+        float coefficients[4];
+        for (u32 j = 0; j < 4; j++) {
+            auto& c = columns[j];
+            coefficients[j] = s[0] * c.x + s[1] * c.y + s[2] * c.z + s[3] * c.w;
+        }
+
+        // NOTE: View space is rotation * (p - eye), so the normal is rotated
+        // back and the eye folded into the distance.
+        Vec3 normal = { coefficients[0], coefficients[1], coefficients[2] };
+        rotatePoint(inverse, normal, normal);
+        float d = coefficients[3] -
+            (normal.x * eye.x + normal.y * eye.y + normal.z * eye.z);
+        planes[i] = { normal.x, normal.y, normal.z, d };
+    }
+}
+
+// NOTE: Picks the corner furthest along each plane's normal once, since the
+// planes are the same for every box.
+struct CullPVertex {
+    const float* x;
+    const float* y;
+    const float* z;
+};
+
+void cullPVertices(CullBounds& bounds, Vec4* planes, CullPVertex* pVertices) {
+    for (u32 i = 0; i < cullPlaneCount; i++) {
+        auto& plane = planes[i];
+        pVertices[i].x = (plane.x >= 0) ? bounds.maxX.data() : bounds.minX.data();
+        pVertices[i].y = (plane.y >= 0) ? bounds.maxY.data() : bounds.minY.data();
+        pVertices[i].z = (plane.z >= 0) ? bounds.maxZ.data() : bounds.minZ.data();
+    }
+}
+
+u32 cullAABBsScalar(CullBounds& bounds, Vec4* planes, u32* visible) {
+    CullPVertex pVertices[cullPlaneCount];
+    cullPVertices(bounds, planes, pVertices);
+
+    u32 visibleCount = 0;
+    for (u32 i = 0; i < bounds.count; i++) {
+        u32 inside = 1;
+        for (u32 p = 0; p < cullPlaneCount; p++) {
+            auto& plane = planes[p];
+            auto& pVertex = pVertices[p];
+            float distance = plane.x * pVertex.x[i] +
+                plane.y * pVertex.y[i] +
+                plane.z * pVertex.z[i] +
+                plane.w;
+            if (distance < 0) {
+                inside = 0;
+                break;
+            }
+        }
+        visible[i] = inside;
+        visibleCount += inside;
+    }
+    return visibleCount;
+}
+
+u32 cullAABBsAVX2(CullBounds& bounds, Vec4* planes, u32* visible) {
+    CullPVertex pVertices[cullPlaneCount];
+    cullPVertices(bounds, planes, pVertices);
+
+    __m256 nx[cullPlaneCount];
+    __m256 ny[cullPlaneCount];
+    __m256 nz[cullPlaneCount];
+    __m256 d[cullPlaneCount];
+    for (u32 p = 0; p < cullPlaneCount; p++) {
+        nx[p] = _mm256_set1_ps(planes[p].x);
+        ny[p] = _mm256_set1_ps(planes[p].y);
+        nz[p] = _mm256_set1_ps(planes[p].z);
+        d[p] = _mm256_set1_ps(planes[p].w);
+    }
+
+    u32 visibleCount = 0;
+    __m256 zero = _mm256_setzero_ps();
+    for (u32 i = 0; i < bounds.count; i += cullBatchWidth) {
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (u32 p = 0; p < cullPlaneCount; p++) {
+            auto& pVertex = pVertices[p];
+            // NOTE: Same operation order as cullAABBsScalar, so both agree
+            // on boxes that touch a plane.
+            __m256 distance = _mm256_mul_ps(nx[p], _mm256_loadu_ps(pVertex.x + i));
+            distance = _mm256_add_ps(
+                distance,
+                _mm256_mul_ps(ny[p], _mm256_loadu_ps(pVertex.y + i))
+            );
+            distance = _mm256_add_ps(
+                distance,
+                _mm256_mul_ps(nz[p], _mm256_loadu_ps(pVertex.z + i))
+            );
+            distance = _mm256_add_ps(distance, d[p]);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, zero, _CMP_GE_OQ));
+            if (_mm256_testz_ps(inside, inside)) break;
+        }
+
+        // NOTE: All ones becomes 1.
+        __m256i flags = _mm256_srli_epi32(_mm256_castps_si256(inside), 31);
+        u32 mask = _mm256_movemask_ps(inside);
+        if (i + cullBatchWidth <= bounds.count) {
+            _mm256_storeu_si256((__m256i*)(visible + i), flags);
+        } else {
+            u32 lanes[cullBatchWidth];
+            _mm256_storeu_si256((__m256i*)lanes, flags);
+            u32 tail = bounds.count - i;
+            memcpy(visible + i, lanes, tail * sizeof(u32));
+            mask &= (1 << tail) - 1;
+        }
+        visibleCount += __popcnt(mask);
+    }
+    return visibleCount;
+}
+
+// Writes 1 to visible for every box that may be in view, 0 otherwise.
+// Returns how many are.
+u32 cullAABBs(CullBounds& bounds, Vec4* planes, u32* visible) {
+    if (cpu.avx2) {
+        return cullAABBsAVX2(bounds, planes, visible);
+    }
+    return cullAABBsScalar(bounds, planes, visible);
+}
+
+// Culls a grid of chunk sized boxes from a few views, checks that the AVX2
+// path agrees with the scalar one and never culls a box with a corner in
+// view, and logs how long each takes. Run with -cull-bench.
+void cullBenchmark() {
+    const i32 gridWidth = 32;
+    const i32 gridHeight = 16;
+    const u32 boxCount = gridWidth * gridHeight * gridWidth;
+    const u32 viewCount = 16;
+    const u32 iterations = 100;
+    const float chunkSize = 16.f;
+
+    CullBounds bounds = {};
+    cullBoundsResize(bounds, boxCount);
+    u32 i = 0;
+    for (i32 y = 0; y < gridHeight; y++) {
+        for (i32 z = 0; z < gridWidth; z++) {
+            for (i32 x = 0; x < gridWidth; x++) {
+                // NOTE: Shrink some boxes, like chunks whose surface doesn't
+                // fill them.
+                float inset = (float)((x * 7 + y * 3 + z * 5) % 4);
+                Vec3 min = {
+                    (x - gridWidth / 2) * chunkSize + inset,
+                    (y - gridHeight / 2) * chunkSize + inset,
+                    (z - gridWidth / 2) * chunkSize + inset
+                };
+                Vec3 max = {
+                    min.x + chunkSize - 2 * inset,
+                    min.y + chunkSize - 2 * inset,
+                    min.z + chunkSize - 2 * inset
+                };
+                cullBoundsSet(bounds, i++, min, max);
+            }
+        }
+    }
+
+    float proj[16];
+    matrixProjection(1920, 1080, toRadians(45.f), 10.f, .1f, proj);
+
+    vector<u32> scalarVisible(boxCount);
+    vector<u32> avxVisible(boxCount);
+    float scalarTime = 0;
+    float avxTime = 0;
+    u32 visibleCount = 0;
+    u32 mismatches = 0;
+    u32 falseNegatives = 0;
+    for (u32 view = 0; view < viewCount; view++) {
+        Quaternion rotation;
+        quaternionInit(rotation);
+        rotateQuaternionY(view * (6.2832f / viewCount), rotation);
+        rotateQuaternionX(((i32)(view % 3) - 1) * .5f, rotation);
+        Vec4 eye = { (float)view, 0, -(float)view, 0 };
+        Vec4 planes[cullPlaneCount];
+        cullFrustumPlanes(proj, eye, rotation, planes);
+
+        START_TIMER(CullScalar);
+        for (u32 j = 0; j < iterations; j++) {
+            visibleCount += cullAABBsScalar(bounds, planes, scalarVisible.data());
+        }
+        END_TIMER(CullScalar);
+        scalarTime += DELTA(CullScalar);
+
+        if (cpu.avx2) {
+            START_TIMER(CullAVX2);
+            for (u32 j = 0; j < iterations; j++) {
+                cullAABBsAVX2(bounds, planes, avxVisible.data());
+            }
+            END_TIMER(CullAVX2);
+            avxTime += DELTA(CullAVX2);
+            for (u32 j = 0; j < boxCount; j++) {
+                if (avxVisible[j] != scalarVisible[j]) mismatches++;
+            }
+        }
+
+        // NOTE: Any corner that projects inside the clip volume must keep its
+        // box, which is what the old corner transform relied on.
+        for (u32 j = 0; j < boxCount; j++) {
+            if (scalarVisible[j]) continue;
+            for (u32 corner = 0; corner < 8; corner++) {
+                Vec3 p = {
+                    (corner & 1) ? bounds.maxX[j] : bounds.minX[j],
+                    (corner & 2) ? bounds.maxY[j] : bounds.minY[j],
+                    (corner & 4) ? bounds.maxZ[j] : bounds.minZ[j]
+                };
+                Vec3 offset = { -eye.x, -eye.y, -eye.z };
+                vectorAdd(p, offset, p);
+                rotatePoint(rotation, p, p);
+                Vec4 r = {};
+                matrixMultiplyPoint(proj, p, r);
+                const float epsilon = 1e-3f;
+                bool inside = (r.z > epsilon) &&
+                    (r.w - r.z > epsilon) &&
+                    (fabsf(r.x) < r.w - epsilon) &&
+                    (fabsf(r.y) < r.w - epsilon);
+                if (inside) {
+                    falseNegatives++;
+                    break;
+                }
+            }
+        }
+    }
+
+    u32 culls = viewCount * iterations;
+    INFO(
+        "Cull bench: %d boxes, %.2f%% visible",
+        boxCount, (float)visibleCount / (culls * boxCount) * 100.f
+    );
+    INFO("Cull bench: scalar %.2fus per cull", scalarTime / culls * 1000000);
+    if (cpu.avx2) {
+        INFO(
+            "Cull bench: AVX2 %.2fus per cull (%.1fx), %d mismatches",
+            avxTime / culls * 1000000,
+            scalarTime / avxTime,
+            mismatches
+        );
+    }
+    INFO("Cull bench: %d false negatives", falseNegatives);
+}
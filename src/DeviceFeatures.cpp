@@ -0,0 +1,53 @@
+// NOTE: Optional device features we use when they're there. initVK creates the
+// device with the features in vk.features, and picks the GPU itself, so we
+// only ask for features every GPU in the system has. Call between
+// createVKInstance and initVK, and read deviceFeatures afterwards.
+
+struct DeviceFeatures {
+    // NOTE: drawCount > 1 in vkCmdDrawIndexedIndirect, see DrawList.cpp.
+    bool multiDrawIndirect;
+    // NOTE: Non-zero firstInstance in indirect draws, which DrawList.cpp
+    // indexes chunk origins with.
+    bool drawIndirectFirstInstance;
+    // NOTE: default.frag writing its depth for Hi-Z, see HiZ.cpp.
+    bool fragmentStoresAndAtomics;
+} deviceFeatures;
+
+void initDeviceFeatures(Vulkan& vk) {
+    u32 gpuCount = 0;
+    VKCHECK(
+        vkEnumeratePhysicalDevices(vk.handle, &gpuCount, nullptr),
+        "could not enumerate physical devices"
+    );
+    vector<VkPhysicalDevice> gpus(gpuCount);
+    VKCHECK(
+        vkEnumeratePhysicalDevices(vk.handle, &gpuCount, gpus.data()),
+        "could not enumerate physical devices"
+    );
+
+    deviceFeatures.multiDrawIndirect = gpuCount > 0;
+    deviceFeatures.drawIndirectFirstInstance = gpuCount > 0;
+    deviceFeatures.fragmentStoresAndAtomics = gpuCount > 0;
+    for (auto gpu: gpus) {
+        VkPhysicalDeviceFeatures supported;
+        vkGetPhysicalDeviceFeatures(gpu, &supported);
+        deviceFeatures.multiDrawIndirect &= (bool)supported.multiDrawIndirect;
+        deviceFeatures.drawIndirectFirstInstance &=
+            (bool)supported.drawIndirectFirstInstance;
+        deviceFeatures.fragmentStoresAndAtomics &=
+            (bool)supported.fragmentStoresAndAtomics;
+    }
+
+    vk.features.multiDrawIndirect = deviceFeatures.multiDrawIndirect;
+    vk.features.drawIndirectFirstInstance = deviceFeatures.drawIndirectFirstInstance;
+    vk.features.fragmentStoresAndAtomics = deviceFeatures.fragmentStoresAndAtomics;
+    if (!deviceFeatures.multiDrawIndirect) {
+        INFO("multiDrawIndirect not supported, chunks are drawn one call each");
+    }
+    if (!deviceFeatures.drawIndirectFirstInstance) {
+        INFO("drawIndirectFirstInstance not supported, chunks are culled on the CPU and drawn one call each");
+    }
+    if (!deviceFeatures.fragmentStoresAndAtomics) {
+        INFO("fragmentStoresAndAtomics not supported, Hi-Z is off");
+    }
+}
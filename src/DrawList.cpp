@@ -0,0 +1,552 @@
+// NOTE: Draws every drawn chunk with one vkCmdDrawIndexedIndirect per device
+// arena block, instead of binding buffers and drawing chunk by chunk.
+// Every residency slot has a DrawChunk in chunks, which holds the chunk's AABB
+// and where its mesh is. A slot is only rewritten when residency says its
+// chunk changed (admitted, drawn or no longer drawn, uploaded, moved or
+// evicted, see residencyChanged), so the render thread does no work per chunk
+// for the ones that didn't. Each frame shaders/cull.comp tests every slot
+// against the view frustum and the draw distance and writes the draw commands
+// of the visible ones into their block's range of commands, which the draws
+// then read. Chunks that pass are also tested against the last frame's depth
+// pyramid (see HiZ.cpp) and dropped if something nearer covered them.
+// With -no-gpu-cull the render thread walks the chunk tree instead, culls what
+// it returns with cullAABBs and writes the commands itself.
+// firstInstance is the chunk's slot, which indexes its origin in origins, which
+// default.vert reads with gl_InstanceIndex. Devices without the
+// drawIndirectFirstInstance feature always cull on the CPU and draw every
+// chunk with its own vkCmdDrawIndexed instead, with its origin pushed.
+// Only touched by the render thread.
+
+// NOTE: Must match DrawChunk in shaders/cull.comp.
+struct DrawChunk {
+    Vec4 aabbMin;
+    Vec4 aabbMax;
+    // NOTE: 0 for slots that aren't drawn.
+    u32 indexCount;
+    u32 firstIndex;
+    i32 vertexOffset;
+    u32 block;
+    u32 vertexCount;
+    u32 padding[3];
+};
+
+// NOTE: Must match CullView in shaders/cull.comp. One per frame in flight.
+struct DrawCullView {
+    Vec4 planes[cullPlaneCount];
+    float proj[16];
+    // NOTE: w is the draw distance, 0 draws everything in view.
+    Vec4 eye;
+    // NOTE: The view the depth pyramid was rendered from.
+    Vec4 hizEye;
+    Vec4 hizRotation;
+    u32 hizWidth;
+    u32 hizHeight;
+    u32 hizLevelCount;
+    u32 hizEnabled;
+    HiZLevel hizLevels[hizMaxLevels];
+};
+
+// NOTE: Must match CullParams in shaders/cull.comp.
+struct DrawCullParams {
+    u32 slotCount;
+    // NOTE: Every block has capacity commands, starting at
+    // (countBase + block) * capacity.
+    u32 capacity;
+    u32 countBase;
+    u32 frameSlot;
+};
+
+// NOTE: Must match DrawStats in shaders/cull.comp. One per frame in flight.
+struct DrawStats {
+    u32 visibleChunks;
+    u32 occludedChunks;
+    u32 visibleVertices;
+    u32 visibleIndices;
+};
+
+// NOTE: Device arena blocks the draw list can draw from. Counts are kept per
+// block.
+const u32 drawListMaxBlocks = 16;
+
+struct DrawList {
+    VulkanPipeline cullPipeline;
+    // NOTE: capacity each of chunks and origins, which are in
+    // chunkDeviceArena and only written with vkCmdUpdateBuffer. commands and
+    // counts have a range per block per frame in flight, stats and views one
+    // per frame in flight. commands is in chunkDeviceArena unless the CPU
+    // culls, the rest in chunkHostArena.
+    ArenaAllocation chunks;
+    ArenaAllocation origins;
+    ArenaAllocation commands;
+    ArenaAllocation counts;
+    ArenaAllocation stats;
+    ArenaAllocation views;
+    // NOTE: Whether chunks was zeroed, which the first frame does.
+    bool cleared;
+    u32 capacity;
+    u32 frameSlot;
+    // NOTE: The block each slot's chunk is drawn from, -1 if it isn't drawn.
+    vector<i32> slotBlocks;
+    // NOTE: Drawn chunks per block, and the buffer of the block they're in.
+    u32 blockChunks[drawListMaxBlocks];
+    VkBuffer blockBuffers[drawListMaxBlocks];
+    // NOTE: Commands each block draws this frame. The drawn chunks with the
+    // cull pass, since the visible count only exists on the GPU.
+    u32 blockDraws[drawListMaxBlocks];
+    // NOTE: Only used when the CPU culls.
+    vector<Chunk*> entries;
+    vector<u32> visibility;
+    Vec4 planes[cullPlaneCount];
+    float proj[16];
+    Vec4 eye;
+    float drawDistance;
+    bool cpuCull;
+    CullBounds bounds;
+    // NOTE: Needs the multiDrawIndirect device feature, see DeviceFeatures.cpp.
+    // Without it every command is drawn on its own, which still saves the
+    // rebinding.
+    bool multiDraw;
+    // NOTE: Needs the drawIndirectFirstInstance device feature. Without it the
+    // CPU culls, and the commands it writes keep the slot in firstInstance
+    // for drawListRecord, which draws them directly.
+    bool firstInstance;
+    u32 drawCalls;
+    // NOTE: Read back from the GPU, so these are framesInFlight frames old
+    // unless the CPU culls.
+    u32 visibleChunks;
+    u32 occludedChunks;
+    u32 visibleVertices;
+    u32 visibleIndices;
+} drawList;
+
+// Reads back what the last frame in this slot found visible. Call once the
+// slot's fence has been waited on.
+void drawListBegin(u32 frameSlot) {
+    drawList.frameSlot = frameSlot;
+    drawList.drawCalls = 0;
+    if (drawList.cpuCull) return;
+
+    auto& stats = ((DrawStats*)drawList.stats.mapped)[frameSlot];
+    drawList.visibleChunks = stats.visibleChunks;
+    drawList.occludedChunks = stats.occludedChunks;
+    drawList.visibleVertices = stats.visibleVertices;
+    drawList.visibleIndices = stats.visibleIndices;
+}
+
+void drawListSetView(
+    float* proj,
+    Vec4& eye,
+    Quaternion& rotation,
+    float drawDistance
+) {
+    cullFrustumPlanes(proj, eye, rotation, drawList.planes);
+    memcpy(drawList.proj, proj, sizeof(drawList.proj));
+    drawList.eye = eye;
+    drawList.drawDistance = drawDistance;
+}
+
+u32 drawListFirstIndex(Chunk* chunk) {
+    return (u32)((chunk->mesh.offset + chunk->indexOffset) / sizeof(u16));
+}
+
+i32 drawListVertexOffset(Chunk* chunk) {
+    return (i32)(chunk->mesh.offset / sizeof(PackedVertex));
+}
+
+// Rewrites the slots residency changed since the last frame, and recounts
+// their blocks.
+void drawListSync(VkCommandBuffer cmd) {
+    auto& changed = residency.changed;
+    if (drawList.cleared && changed.empty()) return;
+
+    // NOTE: Earlier frames may still be culling or drawing with the old
+    // contents.
+    bufferBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+        0,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0
+    );
+    if (!drawList.cleared) {
+        vkCmdFillBuffer(
+            cmd,
+            drawList.chunks.buffer,
+            drawList.chunks.offset,
+            drawList.chunks.size,
+            0
+        );
+        bufferBarrier(
+            cmd,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_ACCESS_TRANSFER_WRITE_BIT
+        );
+        drawList.cleared = true;
+    }
+    for (auto idx: changed) {
+        auto chunk = &residency.chunks[idx];
+        bool drawn = chunk->drawn &&
+            (chunk->state == CHUNK_RESIDENT) &&
+            chunk->indexCount &&
+            (chunk->mesh.arena == &chunkDeviceArena);
+        i32 block = drawn ? (i32)chunk->mesh.block : -1;
+        CHECK(block < (i32)drawListMaxBlocks, "too many arena blocks to draw from");
+        auto& slotBlock = drawList.slotBlocks[idx];
+        if (slotBlock >= 0) drawList.blockChunks[slotBlock]--;
+        if (block >= 0) {
+            drawList.blockChunks[block]++;
+            drawList.blockBuffers[block] = chunk->mesh.buffer;
+        }
+        if (!drawn && (slotBlock < 0)) continue;
+        slotBlock = block;
+
+        DrawChunk record = {};
+        if (drawn) {
+            record.aabbMin = { chunk->min.x, chunk->min.y, chunk->min.z, 0 };
+            record.aabbMax = { chunk->max.x, chunk->max.y, chunk->max.z, 0 };
+            record.indexCount = chunk->indexCount;
+            record.firstIndex = drawListFirstIndex(chunk);
+            record.vertexOffset = drawListVertexOffset(chunk);
+            record.block = block;
+            record.vertexCount = chunk->vertexCount;
+
+            Vec4 origin = chunkParams(*chunk).baseOffset;
+            vkCmdUpdateBuffer(
+                cmd,
+                drawList.origins.buffer,
+                drawList.origins.offset + idx * sizeof(Vec4),
+                sizeof(origin),
+                &origin
+            );
+        }
+        vkCmdUpdateBuffer(
+            cmd,
+            drawList.chunks.buffer,
+            drawList.chunks.offset + idx * sizeof(DrawChunk),
+            sizeof(record),
+            &record
+        );
+    }
+    changed.clear();
+    bufferBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+        VK_ACCESS_SHADER_READ_BIT
+    );
+}
+
+// Culls the chunks the chunk tree returns on the CPU and writes the commands
+// straight into the frame's part of commands, which is host visible then.
+void drawListCullCPU() {
+    auto& entries = drawList.entries;
+    entries.clear();
+    chunkTreeCull(drawList.planes, drawList.eye, drawList.drawDistance, entries);
+    cullBoundsResize(drawList.bounds, (u32)entries.size());
+    for (u32 i = 0; i < entries.size(); i++) {
+        cullBoundsSet(drawList.bounds, i, entries[i]->min, entries[i]->max);
+    }
+    auto& visibility = drawList.visibility;
+    visibility.resize(drawList.bounds.minX.size());
+    cullAABBs(drawList.bounds, drawList.planes, visibility.data());
+
+    drawList.visibleChunks = 0;
+    drawList.occludedChunks = 0;
+    drawList.visibleVertices = 0;
+    drawList.visibleIndices = 0;
+    memset(drawList.blockDraws, 0, sizeof(drawList.blockDraws));
+    u32 countBase = drawList.frameSlot * drawListMaxBlocks;
+    auto commands = (VkDrawIndexedIndirectCommand*)drawList.commands.mapped;
+    for (u32 i = 0; i < entries.size(); i++) {
+        if (!visibility[i]) continue;
+        auto chunk = entries[i];
+        u32 idx = residencyChunkIdx(chunk);
+        i32 block = drawList.slotBlocks[idx];
+        if (block < 0) continue;
+
+        u32 draw = drawList.blockDraws[block]++;
+        auto& command = commands[(countBase + block) * drawList.capacity + draw];
+        command.indexCount = chunk->indexCount;
+        command.instanceCount = 1;
+        command.firstIndex = drawListFirstIndex(chunk);
+        command.vertexOffset = drawListVertexOffset(chunk);
+        command.firstInstance = idx;
+
+        drawList.visibleChunks++;
+        drawList.visibleVertices += chunk->vertexCount;
+        drawList.visibleIndices += chunk->indexCount;
+    }
+}
+
+// Brings the slots up to date and culls them. Has to be recorded outside of
+// the render pass, before drawListRecord.
+void drawListCull(VkCommandBuffer cmd) {
+    drawListSync(cmd);
+    if (drawList.cpuCull) {
+        drawListCullCPU();
+        return;
+    }
+
+    // NOTE: Commands past a block's visible count stay zeroed and draw
+    // nothing.
+    u32 countBase = drawList.frameSlot * drawListMaxBlocks;
+    const VkDeviceSize commandStride = sizeof(VkDrawIndexedIndirectCommand);
+    for (u32 block = 0; block < drawListMaxBlocks; block++) {
+        u32 count = drawList.blockChunks[block];
+        drawList.blockDraws[block] = count;
+        if (!count) continue;
+        VkDeviceSize first = (countBase + block) * drawList.capacity;
+        vkCmdFillBuffer(
+            cmd,
+            drawList.commands.buffer,
+            drawList.commands.offset + first * commandStride,
+            count * commandStride,
+            0
+        );
+    }
+    vkCmdFillBuffer(
+        cmd,
+        drawList.counts.buffer,
+        drawList.counts.offset + countBase * sizeof(u32),
+        drawListMaxBlocks * sizeof(u32),
+        0
+    );
+    vkCmdFillBuffer(
+        cmd,
+        drawList.stats.buffer,
+        drawList.stats.offset + drawList.frameSlot * sizeof(DrawStats),
+        sizeof(DrawStats),
+        0
+    );
+    bufferBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+    );
+
+    auto& pipeline = drawList.cullPipeline;
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.handle);
+    vkCmdBindDescriptorSets(
+        cmd,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        pipeline.layout,
+        0, 1, &pipeline.descriptorSet,
+        0, nullptr
+    );
+    auto& view = ((DrawCullView*)drawList.views.mapped)[drawList.frameSlot];
+    memcpy(view.planes, drawList.planes, sizeof(view.planes));
+    memcpy(view.proj, drawList.proj, sizeof(view.proj));
+    view.eye = drawList.eye;
+    view.eye.w = drawList.drawDistance;
+    view.hizEye = hiz.eye;
+    view.hizRotation = {
+        hiz.rotation.x,
+        hiz.rotation.y,
+        hiz.rotation.z,
+        hiz.rotation.w
+    };
+    view.hizWidth = hiz.header.width;
+    view.hizHeight = hiz.header.height;
+    view.hizLevelCount = hiz.levelCount;
+    view.hizEnabled = hiz.header.enabled && hiz.built;
+    memcpy(view.hizLevels, hiz.levels, sizeof(view.hizLevels));
+
+    DrawCullParams params = {};
+    params.slotCount = residency.slotCount;
+    params.capacity = drawList.capacity;
+    params.countBase = countBase;
+    params.frameSlot = drawList.frameSlot;
+    vkCmdPushConstants(
+        cmd,
+        pipeline.layout,
+        VK_SHADER_STAGE_COMPUTE_BIT,
+        0, sizeof(params), &params
+    );
+    const u32 groupSize = 64;
+    vkCmdDispatch(cmd, (residency.slotCount + groupSize - 1) / groupSize, 1, 1);
+
+    // NOTE: The host reads stats back once the frame's fence is signaled.
+    bufferBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+        VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT
+    );
+}
+
+// Records the chunk draws of the CPU culled commands one by one, pushing each
+// chunk's origin after the view, see chunkVertex.glsl.
+void drawListRecordDirect(
+    VkCommandBuffer cmd,
+    VkPipelineLayout layout,
+    VkDrawIndexedIndirectCommand* commands,
+    u32 count
+) {
+    for (u32 i = 0; i < count; i++) {
+        auto& command = commands[i];
+        auto& chunk = residency.chunks[command.firstInstance];
+        Vec4 origin = chunkParams(chunk).baseOffset;
+        vkCmdPushConstants(
+            cmd,
+            layout,
+            VK_SHADER_STAGE_VERTEX_BIT,
+            2 * sizeof(Vec4), sizeof(origin), &origin
+        );
+        vkCmdDrawIndexed(
+            cmd,
+            command.indexCount,
+            1,
+            command.firstIndex,
+            command.vertexOffset,
+            0
+        );
+    }
+    drawList.drawCalls += count;
+    if (!count) return;
+    Vec4 none = {};
+    vkCmdPushConstants(
+        cmd,
+        layout,
+        VK_SHADER_STAGE_VERTEX_BIT,
+        2 * sizeof(Vec4), sizeof(none), &none
+    );
+}
+
+// Records the draws of every block drawListCull wrote commands for. layout is
+// the chunk pipeline's, which per chunk draws push origins with.
+void drawListRecord(VkCommandBuffer cmd, VkPipelineLayout layout) {
+    u32 countBase = drawList.frameSlot * drawListMaxBlocks;
+    const VkDeviceSize stride = sizeof(VkDrawIndexedIndirectCommand);
+    for (u32 block = 0; block < drawListMaxBlocks; block++) {
+        u32 count = drawList.blockDraws[block];
+        if (!count) continue;
+
+        auto buffer = drawList.blockBuffers[block];
+        VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(cmd, 0, 1, &buffer, &offset);
+        vkCmdBindIndexBuffer(cmd, buffer, 0, VK_INDEX_TYPE_UINT16);
+        u32 first = (countBase + block) * drawList.capacity;
+        VkDeviceSize commandOffset = drawList.commands.offset + first * stride;
+        if (!drawList.firstInstance) {
+            auto commands = (VkDrawIndexedIndirectCommand*)drawList.commands.mapped;
+            drawListRecordDirect(cmd, layout, commands + first, count);
+        } else if (drawList.multiDraw) {
+            vkCmdDrawIndexedIndirect(
+                cmd,
+                drawList.commands.buffer,
+                commandOffset,
+                count,
+                (u32)stride
+            );
+            drawList.drawCalls++;
+        } else {
+            for (u32 i = 0; i < count; i++) {
+                vkCmdDrawIndexedIndirect(
+                    cmd,
+                    drawList.commands.buffer,
+                    commandOffset + i * stride,
+                    1,
+                    (u32)stride
+                );
+            }
+            drawList.drawCalls += count;
+        }
+    }
+}
+
+void initDrawList(
+    Vulkan& vk,
+    VulkanPipeline& pipeline,
+    u32 capacity,
+    bool multiDraw,
+    bool firstInstance,
+    bool cpuCull
+) {
+    CHECK(firstInstance || cpuCull, "culling on the GPU needs drawIndirectFirstInstance");
+    drawList.capacity = capacity;
+    drawList.multiDraw = multiDraw;
+    drawList.firstInstance = firstInstance;
+    drawList.cpuCull = cpuCull;
+    drawList.slotBlocks.resize(capacity, -1);
+    arenaAllocate(
+        chunkDeviceArena,
+        vk,
+        capacity * sizeof(DrawChunk),
+        drawList.chunks
+    );
+    arenaAllocate(
+        chunkDeviceArena,
+        vk,
+        capacity * sizeof(Vec4),
+        drawList.origins
+    );
+    u32 countCount = framesInFlight * drawListMaxBlocks;
+    arenaAllocate(
+        cpuCull ? chunkHostArena : chunkDeviceArena,
+        vk,
+        countCount * capacity * sizeof(VkDrawIndexedIndirectCommand),
+        drawList.commands
+    );
+    arenaAllocate(
+        chunkHostArena,
+        vk,
+        countCount * sizeof(u32),
+        drawList.counts
+    );
+    arenaAllocate(
+        chunkHostArena,
+        vk,
+        framesInFlight * sizeof(DrawStats),
+        drawList.stats
+    );
+    memset(drawList.stats.mapped, 0, drawList.stats.size);
+    arenaAllocate(
+        chunkHostArena,
+        vk,
+        framesInFlight * sizeof(DrawCullView),
+        drawList.views
+    );
+
+    bufferUpdateStorageRange(
+        vk,
+        pipeline.descriptorSet,
+        1,
+        drawList.origins.buffer,
+        drawList.origins.offset,
+        drawList.origins.size
+    );
+
+    if (cpuCull) return;
+
+    // NOTE: Bound once over every frame's part, the frame is picked with
+    // DrawCullParams.
+    initVKPipelineCompute(
+        vk,
+        "cull",
+        drawList.cullPipeline
+    );
+    ArenaAllocation* bindings[] = {
+        &drawList.chunks,
+        &drawList.commands,
+        &drawList.counts,
+        &drawList.stats,
+        &hiz.pyramid,
+        &drawList.views
+    };
+    for (u32 i = 0; i < 6; i++) {
+        bufferUpdateStorageRange(
+            vk,
+            drawList.cullPipeline.descriptorSet,
+            i,
+            bindings[i]->buffer,
+            bindings[i]->offset,
+            bindings[i]->size
+        );
+    }
+}
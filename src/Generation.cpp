@@ -1,143 +1,665 @@
-#include <queue>
-
 #pragma pack(push, 1)
 struct Params {
+    // NOTE: w is the width of a cell, see chunkParams.
     Vec4 baseOffset;
+    // NOTE: w is the pass, see cs.comp.
     Vec4i dimensions;
+    // NOTE: x has a bit set for every face that borders a coarser chunk, see
+    // ChunkFace.
+    Vec4i transitions;
+};
+
+// NOTE: Must match StatsBuffer in cs.comp. Starts with a draw command, but
+// only the counts and the AABB are read back.
+struct ChunkStats {
+    VkDrawIndexedIndirectCommand draw;
+    u32 vertexCount;
+    u32 padding[2];
+    i32 aabbMin[4];
+    i32 aabbMax[4];
 };
 #pragma pack(pop)
 
+// NOTE: Chunk::state moves forward through these. The render thread owns the
+// chunk while it is FREE or PENDING, the generate thread and the pool while it
+// is GENERATING. A QUEUED chunk is claimed by whichever side swaps it to
+// GENERATING or CANCELLED first.
+enum ChunkState {
+    CHUNK_FREE,
+    // NOTE: Requested, but waiting in the scheduler.
+    CHUNK_PENDING,
+    // NOTE: In the generate work queue.
+    CHUNK_QUEUED,
+    // NOTE: Being triangulated, on the GPU or the CPU.
+    CHUNK_GENERATING,
+    // NOTE: Triangulated on the CPU, being packed and uploaded.
+    CHUNK_PACKING,
+    // NOTE: Generated, waiting for the render thread to admit it.
+    CHUNK_READY,
+    // NOTE: Admitted by the residency manager and drawable. Only the render
+    // thread touches it from here on.
+    CHUNK_RESIDENT,
+    // NOTE: No longer wanted by the level of detail while queued. The
+    // generate thread skips it and hands it back as FREE.
+    CHUNK_CANCELLED,
+};
+
+// NOTE: Bit order must match transitionVertex and transitionDensities in
+// cs.comp, which number faces by axis and then by side.
+enum ChunkFace {
+    CHUNK_FACE_NEG_X = 1 << 0,
+    CHUNK_FACE_POS_X = 1 << 1,
+    CHUNK_FACE_NEG_Y = 1 << 2,
+    CHUNK_FACE_POS_Y = 1 << 3,
+    CHUNK_FACE_NEG_Z = 1 << 4,
+    CHUNK_FACE_POS_Z = 1 << 5,
+};
+
 struct Chunk {
+    // NOTE: In units of the chunk's own size, which is computeWidth << level.
     Vec3i coord;
-    VulkanBuffer computeBuffer;
-    VulkanBuffer vertexBuffer;
+    // NOTE: Level of detail. Cells are 1 << level units wide, see Lod.cpp.
+    u32 level;
+    // NOTE: ChunkFace bits of the faces that were meshed to meet a coarser
+    // neighbour. Chunks of the same coord and level with different
+    // transitions are different chunks.
+    u32 transitions;
+    volatile LONG state;
+    // NOTE: Bumped every time the chunk's slot is recycled, see ChunkHandle.
+    u32 generation;
+    u64 lastDrawnFrame;
+    // NOTE: Last frame the level of detail selection picked the chunk to
+    // draw, see Lod.cpp. Only written while the chunk is resident.
+    u64 lodFrame;
+    // NOTE: Picked to draw, either for itself or in place of a chunk that
+    // isn't ready yet. In the chunk tree unless it's empty.
+    bool drawn;
+    // NOTE: Only set while the chunk is being triangulated on the CPU.
+    Vertex* hostVertices;
+    // NOTE: Vertices followed by indices, at indexOffset. Always in
+    // chunkDeviceArena, so every chunk in a block can be drawn with one
+    // multi-draw.
+    ArenaAllocation mesh;
+    VkDeviceSize indexOffset;
+    // NOTE: Meshes built on the CPU are written here (in chunkHostArena) and
+    // copied into mesh by the render thread, see residencyUpload. Meshes built
+    // on the GPU are read back here for the chunk cache, until
+    // generateFinishBatch.
+    ArenaAllocation staging;
+    // NOTE: Where the chunk's mesh is written once it's generated. nullptr if
+    // it came from the cache or isn't cached, see ChunkCache.cpp.
+    ChunkCacheRegion* cacheRegion;
     u32 vertexCount;
+    u32 indexCount;
     Vec3 min;
     Vec3 max;
 };
 
 struct GenerateWorkItem {
     Vulkan* vk;
-    Vec3i coord;
     Chunk* chunk;
+    u32 generation;
+};
+
+enum GenerateBackend {
+    GENERATE_BACKEND_GPU,
+    GENERATE_BACKEND_CPU,
+    // NOTE: Chunks go to the GPU unless there are idle CPU cores.
+    GENERATE_BACKEND_HYBRID,
+};
+
+GenerateBackend generateBackend = GENERATE_BACKEND_GPU;
+
+// NOTE: Bounded lock-free multi producer, single consumer ring. Every slot
+// carries a sequence number that says whether it is ready to be written
+// (sequence == position) or read (sequence == position + 1), so producers
+// only contend on head and never on the consumer. Must be a power of two.
+const u32 generateWorkQueueSize = 1 << 10;
+
+struct GenerateWorkSlot {
+    volatile LONG sequence;
+    GenerateWorkItem item;
+};
+
+struct GenerateWorkQueue {
+    GenerateWorkSlot slots[generateWorkQueueSize];
+    alignas(64) volatile LONG head;
+    alignas(64) LONG tail;
+    // NOTE: Bumped after every push. The generate thread parks on it with
+    // WaitOnAddress when the ring is empty.
+    alignas(64) volatile LONG signal;
+    volatile LONG consumerWaiting;
+} generateWorkQueue;
+VkCommandPool generateCmdPool;
+// NOTE: Chunk meshes and compute scratch are sub-allocated from these instead
+// of getting buffers of their own.
+Arena chunkDeviceArena;
+Arena chunkHostArena;
+
+// NOTE: Everything cs.comp writes to for one chunk. The descriptor set points at
+// the slot's own scratch and stats ranges and is written once, at startup.
+struct ComputeSlot {
+    ArenaAllocation scratch;
+    ArenaAllocation stats;
+    VkDescriptorSet descriptorSet;
+};
+
+// NOTE: A batch is triangulated by one submit, then its meshes are copied
+// out of the slots by a second one. Both signal the batch's fence, which the
+// generate thread polls instead of waiting for the queue to go idle.
+enum ComputeBatchState {
+    COMPUTE_BATCH_FREE,
+    COMPUTE_BATCH_TRIANGULATING,
+    COMPUTE_BATCH_COPYING,
+};
+
+const u32 computeBatchSize = 4;
+const u32 computeBatchCount = 4;
+
+struct ComputeBatch {
+    ComputeBatchState state;
+    VkCommandBuffer cmd;
+    VkFence fence;
+    u32 chunkCount;
+    Chunk* chunks[computeBatchSize];
+    ComputeSlot slots[computeBatchSize];
+    LARGE_INTEGER dispatchTime;
 };
 
-HANDLE generateWorkQueueMutex;
-std::queue<GenerateWorkItem> generateWorkQueue;
-HANDLE generateWorkSemaphore;
+// NOTE: Built once and reused for every chunk. Only touched by the generate
+// thread.
+struct ComputeRing {
+    VulkanPipeline pipeline;
+    VkDescriptorSetLayout descriptorLayout;
+    VkDescriptorPool descriptorPool;
+    ComputeBatch batches[computeBatchCount];
+    u32 batchesDispatched;
+    // NOTE: A begin and an end timestamp per batch, see GpuTimers.cpp.
+    VkQueryPool timestamps;
+} computeRing;
 
 u32 chunksTriangulated = 0;
+// NOTE: Wall clock, from dispatch until the generate thread sees the batch's
+// fence. See gpuTimers.computeTime for how long the GPU spent on it.
 float triangulationTime = 0.f;
 u32 chunksPacked = 0;
 float packTime = 0.f;
+u64 packBytesScanned = 0;
+// NOTE: With -pack-compare every chunk is also packed by the old two pass
+// packer so the two can be compared at exit.
+bool packCompare = false;
+u32 chunksPackedTwoPass = 0;
+float packTwoPassTime = 0.f;
+u64 packTwoPassBytesScanned = 0;
+u32 cpuChunksTriangulated = 0;
+// NOTE: Entirely inside or outside the surface, see chunkTriangulateCPU.
+u32 cpuChunksSkipped = 0;
+float cpuTriangulationTime = 0.f;
+volatile LONG cpuChunksInFlight = 0;
 
 const u32 computeWidth = 16;
 const u32 computeHeight = computeWidth;
 const u32 computeDepth = computeWidth;
 const u32 computeCount = computeWidth * computeHeight * computeDepth;
+// NOTE: Must match TILE_SIZE in cs.comp. Each workgroup triangulates a
+// computeTileSize^3 tile of cells.
+const u32 computeTileSize = 4;
 const u32 computeVerticesPerExecution = 15;
 const u32 computeVertexCount = computeVerticesPerExecution * computeCount;
 const u32 computeVertexWidth = sizeof(Vertex);
 const int computeSize = computeVertexCount * computeVertexWidth;
+// NOTE: Vertices are welded, so there is at most one per lattice edge. That is
+// few enough for 16-bit indices.
+const u32 computeEdgeCount = (computeWidth + 1) * (computeHeight + 1) * (computeDepth + 1) * 3;
+// NOTE: Up to 5 triangles per cell plus a degenerate one to pad odd counts, see
+// emitIndices in cs.comp.
+const u32 computeIndicesPerExecution = 18;
+const u32 computeIndexCount = computeIndicesPerExecution * computeCount;
+// NOTE: cs.comp writes vertices, indices and edges to one scratch buffer.
+const VkDeviceSize computeScratchVertexSize = computeEdgeCount * sizeof(PackedVertex);
+const VkDeviceSize computeScratchIndexSize = computeIndexCount * sizeof(u16);
+const VkDeviceSize computeScratchEdgeSize = (computeCount + computeEdgeCount) * sizeof(u32);
+const VkDeviceSize computeScratchIndexOffset = bufferAlign(computeScratchVertexSize);
+const VkDeviceSize computeScratchEdgeOffset =
+    computeScratchIndexOffset + bufferAlign(computeScratchIndexSize);
+const VkDeviceSize computeScratchSize = computeScratchEdgeOffset + computeScratchEdgeSize;
+
+// NOTE: Maps floats to ints such that the int order matches the float order,
+// so cs.comp can reduce the AABB with integer atomics. Same as in the shader.
+i32 floatToOrdered(float f) {
+    i32 i;
+    memcpy(&i, &f, sizeof(i));
+    return (i >= 0) ? i : (i ^ 0x7fffffff);
+}
 
-void generatePushWorkItem(GenerateWorkItem &workItem) {
-    switch (WaitForSingleObject(generateWorkQueueMutex, 1000)) {
-        case WAIT_ABANDONED:
-            FATAL("generate thread crashed");
-        case WAIT_OBJECT_0:
-            generateWorkQueue.push(workItem);
-            // TODO: error handling
-            ReleaseMutex(generateWorkQueueMutex);
-            // TODO: error handling
-            ReleaseSemaphore(generateWorkSemaphore, 1, nullptr);
-            break;
-        case WAIT_TIMEOUT:
-            FATAL("generate thread hung");
-        case WAIT_FAILED:
-            // TODO: Call GetLastError here and FormatMessage for a more
-            // descriptive error message.
-            FATAL("unknown error");
-    }
-}
-
-GenerateWorkItem generatePopWorkItem() {
-    switch (WaitForSingleObject(generateWorkQueueMutex, 1000)) {
-        case WAIT_ABANDONED: FATAL("generate thread crashed");
-        case WAIT_OBJECT_0: {
-            auto workItem = generateWorkQueue.front();
-            generateWorkQueue.pop();
-            ReleaseMutex(generateWorkQueueMutex);
-            return workItem;
+float orderedToFloat(i32 i) {
+    i = (i >= 0) ? i : (i ^ 0x7fffffff);
+    float f;
+    memcpy(&f, &i, sizeof(f));
+    return f;
+}
+
+// Never blocks. Returns false if the ring is full.
+bool generatePushWorkItem(GenerateWorkItem &workItem) {
+    auto& queue = generateWorkQueue;
+    LONG position = queue.head;
+    GenerateWorkSlot* slot;
+    while (true) {
+        slot = &queue.slots[position & (generateWorkQueueSize - 1)];
+        LONG sequence = slot->sequence;
+        i32 difference = (i32)((u32)sequence - (u32)position);
+        if (difference == 0) {
+            LONG previous = InterlockedCompareExchange(
+                &queue.head,
+                position + 1,
+                position
+            );
+            if (previous == position) break;
+            position = previous;
+        } else if (difference < 0) {
+            return false;
+        } else {
+            position = queue.head;
         }
-        case WAIT_TIMEOUT: FATAL("generate thread hung");
-        // TODO: Call GetLastError here and FormatMessage for a more
-        // descriptive error message.
-        case WAIT_FAILED: FATAL("unknown error");
     }
+    slot->item = workItem;
+    InterlockedExchange(&slot->sequence, position + 1);
+
+    InterlockedIncrement(&queue.signal);
+    if (queue.consumerWaiting) {
+        WakeByAddressSingle((PVOID)&queue.signal);
+    }
+    return true;
 }
 
-void chunkTriangulate(Vulkan& vk, Chunk& chunk) {
-    START_TIMER(Triangulate);
-    // Init & execute compute shader.
-    {
-        VulkanPipeline pipeline;
-        initVKPipelineCompute(
-            vk,
-            "cs",
-            pipeline
+// Only called from the generate thread.
+bool generatePopWorkItem(GenerateWorkItem& workItem) {
+    auto& queue = generateWorkQueue;
+    auto& slot = queue.slots[queue.tail & (generateWorkQueueSize - 1)];
+    if (slot.sequence != queue.tail + 1) return false;
+    workItem = slot.item;
+    InterlockedExchange(&slot.sequence, queue.tail + generateWorkQueueSize);
+    queue.tail++;
+    return true;
+}
+
+// NOTE: Every level has the same number of cells per chunk, only wider. Cell
+// rows start one cell below the origin (see vertexOffsets in cs.comp), so the
+// origin is raised by one cell less one unit to line every level's chunks up
+// with level 0's.
+Params chunkParams(Chunk& chunk) {
+    float cellSize = (float)(1 << chunk.level);
+    Params params = {
+        {
+            chunk.coord.x * computeWidth * cellSize,
+            chunk.coord.y * computeHeight * cellSize + cellSize - 1.f,
+            chunk.coord.z * computeDepth * cellSize,
+            cellSize
+        },
+        {
+            computeWidth,
+            computeHeight,
+            computeDepth,
+            0
+        },
+        {
+            (i32)chunk.transitions,
+            0,
+            0,
+            0
+        }
+    };
+    return params;
+}
+
+// The coordinate of the level 0 chunk in the chunk's lowest corner.
+Vec3i chunkBaseCoord(Chunk& chunk) {
+    i32 scale = 1 << chunk.level;
+    return {
+        chunk.coord.x * scale,
+        chunk.coord.y * scale,
+        chunk.coord.z * scale
+    };
+}
+
+// Writes the chunk's packed mesh to the chunk cache, if it's cached. The
+// counts and the AABB must already be set.
+void chunkCacheStore(Chunk& chunk, void* vertices, void* indices) {
+    if (!chunk.cacheRegion) return;
+    ChunkCacheRecord record = {};
+    record.key = chunkCacheKey(chunk.coord, chunk.level, chunk.transitions);
+    record.vertexCount = chunk.vertexCount;
+    record.indexCount = chunk.indexCount;
+    record.min = chunk.min;
+    record.max = chunk.max;
+    chunkCacheWrite(*chunk.cacheRegion, record, vertices, indices);
+    chunk.cacheRegion = nullptr;
+}
+
+void chunkWriteStats(
+    ChunkStats* stats,
+    Chunk& chunk,
+    u32 vertexCount,
+    u32 indexCount
+) {
+    *stats = {};
+    stats->draw.indexCount = indexCount;
+    stats->draw.instanceCount = 1;
+    stats->vertexCount = vertexCount;
+    stats->aabbMin[0] = floatToOrdered(chunk.min.x);
+    stats->aabbMin[1] = floatToOrdered(chunk.min.y);
+    stats->aabbMin[2] = floatToOrdered(chunk.min.z);
+    stats->aabbMax[0] = floatToOrdered(chunk.max.x);
+    stats->aabbMax[1] = floatToOrdered(chunk.max.y);
+    stats->aabbMax[2] = floatToOrdered(chunk.max.z);
+}
+
+u32 generateBatchQuery(ComputeBatch& batch) {
+    return (u32)(&batch - computeRing.batches) * 2;
+}
+
+void generateBeginBatch(Vulkan& vk, ComputeBatch& batch) {
+    VKCHECK(vkResetCommandBuffer(batch.cmd, 0));
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VKCHECK(vkBeginCommandBuffer(batch.cmd, &beginInfo));
+}
+
+// Submits the batch's commands without waiting for them. The batch's fence is
+// signaled once they are done.
+void generateSubmitBatch(Vulkan& vk, ComputeBatch& batch) {
+    VKCHECK(vkEndCommandBuffer(batch.cmd));
+    VKCHECK(vkResetFences(vk.device, 1, &batch.fence));
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.cmd;
+    VKCHECK(vkQueueSubmit(vk.computeQueue, 1, &submitInfo, batch.fence));
+}
+
+// Triangulates every chunk in the batch with one submit.
+void generateDispatchBatch(Vulkan& vk, ComputeBatch& batch) {
+    auto& ring = computeRing;
+    auto cmd = batch.cmd;
+    generateBeginBatch(vk, batch);
+    if (gpuTimers.computeSupported) {
+        u32 query = generateBatchQuery(batch);
+        vkCmdResetQueryPool(cmd, ring.timestamps, query, 2);
+        vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, ring.timestamps, query);
+    }
+    for (u32 i = 0; i < batch.chunkCount; i++) {
+        auto& chunk = *batch.chunks[i];
+        auto& slot = batch.slots[i];
+        chunk.min = {  INFINITY,  INFINITY,  INFINITY };
+        chunk.max = { -INFINITY, -INFINITY, -INFINITY };
+        chunkWriteStats((ChunkStats*)slot.stats.mapped, chunk, 0, 0);
+        vkCmdFillBuffer(
+            cmd,
+            slot.scratch.buffer,
+            slot.scratch.offset + computeScratchEdgeOffset,
+            computeScratchEdgeSize,
+            0xffffffff
         );
-        createStorageBuffer(
-            vk.device,
-            vk.memories,
-            vk.computeQueueFamily,
-            computeSize,
-            chunk.computeBuffer
+    }
+    bufferBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+    );
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, ring.pipeline.handle);
+
+    // NOTE: The index pass reads the edge map written by every workgroup of
+    // the vertex pass, so the two have to be separate dispatches. Chunks don't
+    // share anything, so one barrier between the passes covers all of them.
+    for (i32 pass = 0; pass < 2; pass++) {
+        if (pass > 0) {
+            bufferBarrier(
+                cmd,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_ACCESS_SHADER_WRITE_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+            );
+        }
+        for (u32 i = 0; i < batch.chunkCount; i++) {
+            vkCmdBindDescriptorSets(
+                cmd,
+                VK_PIPELINE_BIND_POINT_COMPUTE,
+                ring.pipeline.layout,
+                0, 1, &batch.slots[i].descriptorSet,
+                0, nullptr
+            );
+            Params params = chunkParams(*batch.chunks[i]);
+            params.dimensions.w = pass;
+            vkCmdPushConstants(
+                cmd,
+                ring.pipeline.layout,
+                VK_SHADER_STAGE_COMPUTE_BIT,
+                0, sizeof(params), &params
+            );
+            vkCmdDispatch(
+                cmd,
+                computeWidth / computeTileSize,
+                computeHeight / computeTileSize,
+                computeDepth / computeTileSize
+            );
+        }
+    }
+    // NOTE: Makes the stats visible to the host once the fence is signaled.
+    bufferBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT,
+        VK_ACCESS_HOST_READ_BIT
+    );
+    if (gpuTimers.computeSupported) {
+        vkCmdWriteTimestamp(
+            cmd,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            ring.timestamps,
+            generateBatchQuery(batch) + 1
         );
-        updateStorageBuffer(
-            vk.device,
-            pipeline.descriptorSet,
-            0,
-            chunk.computeBuffer.handle
+    }
+    generateSubmitBatch(vk, batch);
+
+    QueryPerformanceCounter(&batch.dispatchTime);
+    batch.state = COMPUTE_BATCH_TRIANGULATING;
+    ring.batchesDispatched++;
+}
+
+void generateFinishBatch(ComputeBatch& batch) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    float latency = (float)(now.QuadPart - batch.dispatchTime.QuadPart) /
+        (float)counterFrequency.QuadPart;
+    for (u32 i = 0; i < batch.chunkCount; i++) {
+        auto& chunk = *batch.chunks[i];
+        INFO(
+            "Triangulated chunk (%dx %dy %dz, level %d)",
+            chunk.coord.x, chunk.coord.y, chunk.coord.z, chunk.level
         );
-        Params params = {
-            {
-                chunk.coord.x * (float)computeWidth,
-                chunk.coord.y * (float)computeHeight,
-                chunk.coord.z * (float)computeDepth,
-                0
-            },
-            {
-                computeWidth,
-                computeHeight,
-                computeDepth,
-                0
+        if (chunk.staging.arena) {
+            chunkCacheStore(
+                chunk,
+                chunk.staging.mapped,
+                chunk.staging.mapped + chunk.indexOffset
+            );
+            arenaFree(chunk.staging);
+        }
+        InterlockedExchange(&chunk.state, CHUNK_READY);
+        triangulationTime += latency;
+        chunksTriangulated++;
+    }
+    batch.chunkCount = 0;
+    batch.state = COMPUTE_BATCH_FREE;
+}
+
+// NOTE: The shader appends vertices and indices to the front of their regions
+// of each slot's scratch, so only the stats are read back and the meshes are
+// copied into tightly sized allocations on the GPU.
+void generateCopyBatch(Vulkan& vk, ComputeBatch& batch) {
+    auto cmd = batch.cmd;
+    bool copied = false;
+    bool readBack = false;
+    float gpuTime;
+    if (gpuTimers.computeSupported &&
+            gpuTimerRead(
+                vk,
+                computeRing.timestamps,
+                generateBatchQuery(batch),
+                1,
+                gpuTimers.computeMask,
+                &gpuTime
+            )) {
+        gpuTimers.computeTime = gpuTime;
+        gpuTimers.computeTotal += gpuTime;
+        gpuTimers.batchesTimed++;
+    }
+    generateBeginBatch(vk, batch);
+    for (u32 i = 0; i < batch.chunkCount; i++) {
+        auto& chunk = *batch.chunks[i];
+        auto& scratch = batch.slots[i].scratch;
+        auto stats = (ChunkStats*)batch.slots[i].stats.mapped;
+        u32 vertexCount = stats->vertexCount;
+        u32 indexCount = stats->draw.indexCount;
+        chunk.min.x = orderedToFloat(stats->aabbMin[0]);
+        chunk.min.y = orderedToFloat(stats->aabbMin[1]);
+        chunk.min.z = orderedToFloat(stats->aabbMin[2]);
+        chunk.max.x = orderedToFloat(stats->aabbMax[0]);
+        chunk.max.y = orderedToFloat(stats->aabbMax[1]);
+        chunk.max.z = orderedToFloat(stats->aabbMax[2]);
+
+        if (indexCount) {
+            VkDeviceSize vertexSize = vertexCount * sizeof(PackedVertex);
+            VkDeviceSize indexSize = indexCount * sizeof(u16);
+            chunk.indexOffset = vertexSize;
+            arenaAllocate(chunkDeviceArena, vk, vertexSize + indexSize, chunk.mesh);
+
+            VkBufferCopy regions[2] = {};
+            regions[0].srcOffset = scratch.offset;
+            regions[0].dstOffset = chunk.mesh.offset;
+            regions[0].size = vertexSize;
+            regions[1].srcOffset = scratch.offset + computeScratchIndexOffset;
+            regions[1].dstOffset = chunk.mesh.offset + chunk.indexOffset;
+            regions[1].size = indexSize;
+            vkCmdCopyBuffer(
+                cmd,
+                scratch.buffer,
+                chunk.mesh.buffer,
+                2, regions
+            );
+            // NOTE: Read back into staging for the chunk cache, which is
+            // written once the copy is done.
+            if (chunk.cacheRegion) {
+                arenaAllocate(chunkHostArena, vk, vertexSize + indexSize, chunk.staging);
+                regions[0].dstOffset = chunk.staging.offset;
+                regions[1].dstOffset = chunk.staging.offset + chunk.indexOffset;
+                vkCmdCopyBuffer(
+                    cmd,
+                    scratch.buffer,
+                    chunk.staging.buffer,
+                    2, regions
+                );
+                readBack = true;
             }
-        };
-        dispatchCompute(
-            vk,
-            pipeline,
-            computeWidth, computeHeight, computeDepth,
-            sizeof(params), &params
+            copied = true;
+        }
+        chunk.vertexCount = vertexCount;
+        chunk.indexCount = indexCount;
+        if (!indexCount) chunkCacheStore(chunk, nullptr, nullptr);
+    }
+
+    if (readBack) {
+        bufferBarrier(
+            cmd,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT,
+            VK_ACCESS_HOST_READ_BIT
         );
-        vkQueueWaitIdle(vk.computeQueue);
     }
-    END_TIMER(Triangulate);
-    triangulationTime += DELTA(Triangulate);
-    chunksTriangulated++;
+    if (copied) {
+        generateSubmitBatch(vk, batch);
+        batch.state = COMPUTE_BATCH_COPYING;
+    } else {
+        VKCHECK(vkEndCommandBuffer(cmd));
+        generateFinishBatch(batch);
+    }
 }
 
-void chunkPack(
-    Vulkan& vk,
-    Chunk& chunk
-) {
-    START_TIMER(Pack);
+// Moves every batch whose fence is signaled on to its next step. Returns true
+// if any batch is still on the GPU.
+bool generateRetireBatches(Vulkan& vk) {
+    bool inFlight = false;
+    for (auto& batch: computeRing.batches) {
+        if (batch.state == COMPUTE_BATCH_FREE) continue;
+        if (vkGetFenceStatus(vk.device, batch.fence) != VK_SUCCESS) {
+            inFlight = true;
+            continue;
+        }
+        if (batch.state == COMPUTE_BATCH_TRIANGULATING) {
+            generateCopyBatch(vk, batch);
+        } else {
+            generateFinishBatch(batch);
+        }
+        inFlight |= (batch.state != COMPUTE_BATCH_FREE);
+    }
+    return inFlight;
+}
 
-    auto computedVertices = (Vertex*)mapMemory(vk.device, chunk.computeBuffer.memory);
+// Blocks until any batch's fence is signaled, or for at most timeout
+// nanoseconds.
+void generateWaitForBatches(Vulkan& vk, u64 timeout) {
+    VkFence fences[computeBatchCount];
+    u32 fenceCount = 0;
+    for (auto& batch: computeRing.batches) {
+        if (batch.state != COMPUTE_BATCH_FREE) fences[fenceCount++] = batch.fence;
+    }
+    if (!fenceCount) return;
+    vkWaitForFences(vk.device, fenceCount, fences, VK_FALSE, timeout);
+}
 
-    chunk.min = {  INFINITY,  INFINITY,  INFINITY };
-    chunk.max = { -INFINITY, -INFINITY, -INFINITY };
+ComputeBatch* generateFreeBatch() {
+    for (auto& batch: computeRing.batches) {
+        if (batch.state == COMPUTE_BATCH_FREE) return &batch;
+    }
+    return nullptr;
+}
 
+// NOTE: Leaves hostVertices null for chunks the surface doesn't pass
+// through, which skip the vertex slots and chunkPack altogether.
+void chunkTriangulateCPU(Chunk& chunk) {
+    START_TIMER(TriangulateCPU);
+    Params params = chunkParams(chunk);
+    auto& lattice = meshLattice;
+    bool crossed = meshSampleLattice(
+        lattice,
+        params.baseOffset,
+        params.dimensions,
+        (u32)params.transitions.x
+    );
+    if (crossed) {
+        chunk.hostVertices = (Vertex*)malloc(computeSize);
+        meshTriangulate(lattice, params.dimensions, chunk.hostVertices);
+    } else {
+        cpuChunksSkipped++;
+    }
+    END_TIMER(TriangulateCPU);
+    cpuTriangulationTime += DELTA(TriangulateCPU);
+    cpuChunksTriangulated++;
+}
+
+// NOTE: The original packer. It walks the slots once to count vertices and
+// again to copy them. Only kept around for -pack-compare.
+u32 packTwoPass(Vertex* computedVertices, Vertex*& packedVertices) {
     u32 vertexCount = 0;
+    Vec3 min = {  INFINITY,  INFINITY,  INFINITY };
+    Vec3 max = { -INFINITY, -INFINITY, -INFINITY };
     {
         auto src = computedVertices;
         for (int i = 0; i < computeCount; i++) {
@@ -149,29 +671,23 @@ void chunkPack(
                     break;
                 } else {
                     vertexCount++;
+                    if (src->position.x < min.x) min.x = src->position.x;
+                    if (src->position.y < min.y) min.y = src->position.y;
+                    if (src->position.z < min.z) min.z = src->position.z;
+                    if (src->position.x > max.x) max.x = src->position.x;
+                    if (src->position.y > max.y) max.y = src->position.y;
+                    if (src->position.z > max.z) max.z = src->position.z;
                     src++;
-                    if (src->position.x < chunk.min.x) chunk.min.x = src->position.x;
-                    if (src->position.y < chunk.min.y) chunk.min.y = src->position.y;
-                    if (src->position.z < chunk.min.z) chunk.min.z = src->position.z;
-                    if (src->position.x > chunk.max.x) chunk.max.x = src->position.x;
-                    if (src->position.y > chunk.max.y) chunk.max.y = src->position.y;
-                    if (src->position.z > chunk.max.z) chunk.max.z = src->position.z;
                 }
             }
         }
+        packTwoPassBytesScanned += (u8*)src - (u8*)computedVertices;
     }
 
-    createVertexBuffer(
-        vk.device,
-        vk.memories,
-        vk.queueFamily,
-        vertexCount * sizeof(Vertex),
-        chunk.vertexBuffer
-    );
-
+    packedVertices = (Vertex*)malloc(vertexCount * sizeof(Vertex));
     {
         auto src = computedVertices;
-        auto dst = (Vertex*)mapMemory(vk.device, chunk.vertexBuffer.memory);
+        auto dst = packedVertices;
         for (int i = 0; i < computeCount; i++) {
             for (int j = 0; j < computeVerticesPerExecution; j++) {
                 if ((src->position.x == 0.f) &&
@@ -186,13 +702,169 @@ void chunkPack(
                 }
             }
         }
-        unMapMemory(vk.device, chunk.computeBuffer.memory);
-        unMapMemory(vk.device, chunk.vertexBuffer.memory);
-        destroyBuffer(vk, chunk.computeBuffer);
-        chunk.computeBuffer = {};
+        packTwoPassBytesScanned += (u8*)src - (u8*)computedVertices;
+    }
+    return vertexCount;
+}
+
+// Moves every vertex in the slots to the front of vertices in a single pass and
+// returns how many there are. Each slot holds up to 5 triangles, back to back,
+// followed by zeroed vertices, so a slot is classified by comparing the first
+// vertex of each of its triangles against zero.
+u32 packCompact(Vertex* vertices, Vec3& min, Vec3& max) {
+    const u32 trianglesPerSlot = computeVerticesPerExecution / 3;
+    __m128 zero = _mm_setzero_ps();
+    __m128 aabbMin = _mm_set1_ps(INFINITY);
+    __m128 aabbMax = _mm_set1_ps(-INFINITY);
+
+    // NOTE: Compacting in place is safe because dst never runs ahead of the
+    // vertex being read.
+    auto dst = vertices;
+    // NOTE: Bytes actually loaded, the probes of every slot plus the vertices
+    // that are copied.
+    u64 bytesScanned = 0;
+    for (u32 cellIdx = 0; cellIdx < computeCount; cellIdx++) {
+        auto slot = vertices + cellIdx * computeVerticesPerExecution;
+
+        bytesScanned += trianglesPerSlot * sizeof(__m128);
+        u32 occupied = 0;
+        for (u32 triangleIdx = 0; triangleIdx < trianglesPerSlot; triangleIdx++) {
+            __m128 position = _mm_loadu_ps(&slot[triangleIdx * 3].position.x);
+            u32 zeroMask = _mm_movemask_ps(_mm_cmpeq_ps(position, zero)) & 0x7;
+            occupied |= (zeroMask != 0x7) << triangleIdx;
+        }
+        if (!occupied) continue;
+
+        u32 triangleCount = 0;
+        while (occupied & (1 << triangleCount)) triangleCount++;
+        bytesScanned += triangleCount * 3 * sizeof(Vertex);
+
+        for (u32 i = 0; i < triangleCount * 3; i++) {
+            __m128 position = _mm_loadu_ps(&slot[i].position.x);
+            __m128 normal = _mm_loadu_ps(&slot[i].normal.x);
+            aabbMin = _mm_min_ps(aabbMin, position);
+            aabbMax = _mm_max_ps(aabbMax, position);
+            _mm_storeu_ps(&dst->position.x, position);
+            _mm_storeu_ps(&dst->normal.x, normal);
+            dst++;
+        }
+    }
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, aabbMin);
+    min = { lanes[0], lanes[1], lanes[2] };
+    _mm_storeu_ps(lanes, aabbMax);
+    max = { lanes[0], lanes[1], lanes[2] };
+
+    packBytesScanned += bytesScanned;
+    return (u32)(dst - vertices);
+}
+
+// NOTE: Must match shaders/vertex.glsl.
+const float packPositionScale = 1024.f;
+const float packPositionBias = 1.f;
+
+// Octahedral encodes a unit vector into 8 bits per component.
+u32 packNormal(Vec4& normal) {
+    float l1 = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+    float x = normal.x / l1;
+    float y = normal.y / l1;
+    if (normal.z < 0.f) {
+        float wrappedX = (1.f - fabsf(y)) * (x >= 0.f ? 1.f : -1.f);
+        float wrappedY = (1.f - fabsf(x)) * (y >= 0.f ? 1.f : -1.f);
+        x = wrappedX;
+        y = wrappedY;
+    }
+    auto quantize = [](float f) {
+        f = f * .5f + .5f;
+        f = (f < 0.f) ? 0.f : ((f > 1.f) ? 1.f : f);
+        return (u32)roundf(f * 255.f);
+    };
+    return quantize(x) | (quantize(y) << 8);
+}
+
+// NOTE: Positions are stored in cells, origin.w wide, so every level of
+// detail gets the same range.
+PackedVertex packVertex(Vertex& vertex, Vec4& origin) {
+    auto quantize = [](float f, float base, float cellSize) {
+        return (u32)roundf(((f - base) / cellSize + packPositionBias) * packPositionScale);
+    };
+    PackedVertex packed;
+    packed.positionXY =
+        quantize(vertex.position.x, origin.x, origin.w) |
+        (quantize(vertex.position.y, origin.y, origin.w) << 16);
+    packed.positionZNormal =
+        quantize(vertex.position.z, origin.z, origin.w) |
+        (packNormal(vertex.normal) << 16);
+    return packed;
+}
+
+// Copies data into mapped (usually write combined) memory with non-temporal
+// stores so it doesn't pollute the cache on the way out.
+void packStream(void* dst, void* src, size_t size) {
+    if ((uintptr_t)dst & 0xf) {
+        memcpy(dst, src, size);
+        return;
+    }
+    auto d = (u8*)dst;
+    auto s = (u8*)src;
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        _mm_stream_si128((__m128i*)(d + i), _mm_loadu_si128((__m128i*)(s + i)));
+    }
+    memcpy(d + i, s + i, size - i);
+    _mm_sfence();
+}
+
+void chunkPack(
+    Vulkan& vk,
+    Chunk& chunk
+) {
+    if (!chunk.hostVertices) {
+        chunk.vertexCount = 0;
+        chunk.indexCount = 0;
+        chunkCacheStore(chunk, nullptr, nullptr);
+        return;
+    }
+
+    if (packCompare) {
+        START_TIMER(PackTwoPass);
+        Vertex* packedVertices;
+        packTwoPass(chunk.hostVertices, packedVertices);
+        END_TIMER(PackTwoPass);
+        free(packedVertices);
+        packTwoPassTime += DELTA(PackTwoPass);
+        chunksPackedTwoPass++;
+    }
+
+    START_TIMER(Pack);
+
+    u32 indexCount = packCompact(chunk.hostVertices, chunk.min, chunk.max);
+    auto indices = (u16*)malloc(indexCount * sizeof(u16));
+    Vec4 origin = chunkParams(chunk).baseOffset;
+    u32 vertexCount = meshWeld(chunk.hostVertices, indexCount, origin.w, indices);
+    meshSmoothNormals(chunk.hostVertices, vertexCount);
+
+    // NOTE: Packed in place, PackedVertex is smaller than Vertex.
+    auto packedVertices = (PackedVertex*)chunk.hostVertices;
+    for (u32 i = 0; i < vertexCount; i++) {
+        packedVertices[i] = packVertex(chunk.hostVertices[i], origin);
     }
 
+    if (indexCount) {
+        VkDeviceSize vertexSize = vertexCount * sizeof(PackedVertex);
+        VkDeviceSize indexSize = indexCount * sizeof(u16);
+        chunk.indexOffset = vertexSize;
+        arenaAllocate(chunkHostArena, vk, vertexSize + indexSize, chunk.staging);
+        packStream(chunk.staging.mapped, packedVertices, vertexSize);
+        packStream(chunk.staging.mapped + chunk.indexOffset, indices, indexSize);
+    }
     chunk.vertexCount = vertexCount;
+    chunk.indexCount = indexCount;
+    chunkCacheStore(chunk, packedVertices, indices);
+    free(indices);
+    free(chunk.hostVertices);
+    chunk.hostVertices = nullptr;
 
     INFO(
         "Packed chunk (%dx %dy %dz)",
@@ -204,95 +876,381 @@ void chunkPack(
     chunksPacked++;
 }
 
-struct PackParams {
+struct MeshParams {
     Vulkan* vk;
     Chunk* chunk;
 };
 
-DWORD WINAPI PackThread(LPVOID param) {
-    auto params = (PackParams*)param;
+void meshChunkTask(void* data) {
+    auto params = (MeshParams*)data;
     auto& chunk = *params->chunk;
-    chunkPack(*params->vk, *params->chunk);
+    chunkTriangulateCPU(chunk);
+    INFO(
+        "Triangulated chunk on CPU (%dx %dy %dz)",
+        chunk.coord.x, chunk.coord.y, chunk.coord.z
+    );
+    InterlockedExchange(&chunk.state, CHUNK_PACKING);
+    chunkPack(*params->vk, chunk);
+    InterlockedExchange(&chunk.state, CHUNK_READY);
+    InterlockedDecrement(&cpuChunksInFlight);
     delete params;
-    return 0;
 }
 
-void generateChunk(
-    Vulkan& vk,
-    Vec3i chunkCoord,
-    Chunk& chunk
-) {
-    chunk = {};
-    chunk.coord = chunkCoord;
+struct CacheLoadParams {
+    Vulkan* vk;
+    Chunk* chunk;
+    ChunkCacheRegion* region;
+    u64 offset;
+};
 
-    INFO(
-        "Generating chunk (%dx %dy %dz)",
-        chunk.coord.x, chunk.coord.y, chunk.coord.z
+void cacheLoadTask(void* data) {
+    auto params = (CacheLoadParams*)data;
+    auto& chunk = *params->chunk;
+    START_TIMER(CacheLoad);
+    VkDeviceSize vertexSize = chunk.vertexCount * sizeof(PackedVertex);
+    VkDeviceSize indexSize = chunk.indexCount * sizeof(u16);
+    chunk.indexOffset = vertexSize;
+    arenaAllocate(chunkHostArena, *params->vk, vertexSize + indexSize, chunk.staging);
+    chunkCacheRead(
+        *params->region,
+        params->offset,
+        chunk.staging.mapped,
+        vertexSize + indexSize
     );
-    chunkTriangulate(vk, chunk);
+    END_TIMER(CacheLoad);
+    InterlockedAdd64(&chunkCache.loadMicroseconds, (LONG64)(DELTA(CacheLoad) * 1000 * 1000));
+    InterlockedIncrement(&chunkCache.loaded);
     INFO(
-        "Triangulated chunk (%dx %dy %dz)",
+        "Loaded chunk from cache (%dx %dy %dz)",
         chunk.coord.x, chunk.coord.y, chunk.coord.z
     );
-    auto params = new PackParams;
+    InterlockedExchange(&chunk.state, CHUNK_READY);
+    delete params;
+}
+
+// Starts loading the chunk from the chunk cache and returns true if it's in
+// there. Otherwise leaves chunk.cacheRegion set so it's written once it's
+// generated.
+bool generateFromCache(Vulkan& vk, Chunk& chunk) {
+    auto region = chunkCacheOpen(chunk.coord, chunk.level);
+    if (!region) return false;
+    ChunkCacheRecord record;
+    u64 offset;
+    u64 key = chunkCacheKey(chunk.coord, chunk.level, chunk.transitions);
+    if (!chunkCacheFind(*region, key, record, offset)) {
+        chunkCache.misses++;
+        chunk.cacheRegion = region;
+        return false;
+    }
+    chunkCache.hits++;
+    chunk.vertexCount = record.vertexCount;
+    chunk.indexCount = record.indexCount;
+    chunk.min = record.min;
+    chunk.max = record.max;
+    // NOTE: Chunks without a surface don't need anything read.
+    if (!chunk.indexCount) {
+        InterlockedExchange(&chunk.state, CHUNK_READY);
+        return true;
+    }
+    auto params = new CacheLoadParams;
     params->vk = &vk;
     params->chunk = &chunk;
-    CreateThread(
-        NULL,
-        0,
-        PackThread,
-        params,
-        0,
-        NULL
+    params->region = region;
+    params->offset = offset;
+    poolRelease(poolSubmit(cacheLoadTask, params));
+    return true;
+}
+
+bool generateOnCPU() {
+    switch (generateBackend) {
+        case GENERATE_BACKEND_GPU: return false;
+        case GENERATE_BACKEND_CPU: return true;
+        case GENERATE_BACKEND_HYBRID: {
+            LONG idleWorkers = (LONG)pool.workerCount - cpuChunksInFlight;
+            return idleWorkers > 0;
+        }
+    }
+    return false;
+}
+
+// Claims the chunk and starts it on the CPU, or returns true if it should be
+// added to a GPU batch.
+bool generateChunk(
+    Vulkan& vk,
+    Chunk& chunk
+) {
+    auto previousState = InterlockedCompareExchange(
+        &chunk.state,
+        CHUNK_GENERATING,
+        CHUNK_QUEUED
+    );
+    if (previousState != CHUNK_QUEUED) {
+        InterlockedExchange(&chunk.state, CHUNK_FREE);
+        return false;
+    }
+    // NOTE: The render thread still reads the chunk's state, coord, level and
+    // transitions while it's in flight, so only the fields generation writes
+    // are reset. Zeroing the whole chunk would briefly make it look FREE.
+    chunk.hostVertices = nullptr;
+    chunk.mesh = {};
+    chunk.indexOffset = 0;
+    chunk.staging = {};
+    chunk.cacheRegion = nullptr;
+    chunk.vertexCount = 0;
+    chunk.indexCount = 0;
+    chunk.min = {};
+    chunk.max = {};
+
+    INFO(
+        "Generating chunk (%dx %dy %dz)",
+        chunk.coord.x, chunk.coord.y, chunk.coord.z
     );
+    if (generateFromCache(vk, chunk)) return false;
+    if (generateOnCPU()) {
+        InterlockedIncrement(&cpuChunksInFlight);
+        auto params = new MeshParams;
+        params->vk = &vk;
+        params->chunk = &chunk;
+        poolRelease(poolSubmit(meshChunkTask, params));
+        return false;
+    }
+    return true;
 }
 
+// NOTE: How long the generate thread sleeps on the batch fences before it
+// looks at the work queue again.
+const u64 generatePollTimeout = 1000 * 1000;
+
 [[noreturn]] DWORD WINAPI GenerateThread(LPVOID param) {
+    auto& vk = *(Vulkan*)param;
+    auto& queue = generateWorkQueue;
     while (true) {
-        // NOTE: Wait for work to be enqueued so the thread doesn't just spin.
-        switch (WaitForSingleObject(generateWorkSemaphore, INFINITE)) {
-            case WAIT_ABANDONED: FATAL("semaphore abandoned");
-            case WAIT_OBJECT_0: {
-                while (!generateWorkQueue.empty()) {
-                    auto workItem = generatePopWorkItem();
-                    generateChunk(
-                        *workItem.vk,
-                        workItem.coord,
-                        *workItem.chunk
-                    );
-                }
+        bool inFlight = generateRetireBatches(vk);
+
+        // NOTE: Announce that we may park before the last look at the ring, so
+        // a producer either sees consumerWaiting or its item gets popped.
+        InterlockedExchange(&queue.consumerWaiting, 1);
+        LONG signal = queue.signal;
+
+        // NOTE: Leave work in the ring while every batch is busy, the
+        // scheduler can still cancel it there.
+        auto batch = generateFreeBatch();
+        bool popped = false;
+        GenerateWorkItem workItem;
+        while (batch &&
+                (batch->chunkCount < computeBatchSize) &&
+                generatePopWorkItem(workItem)) {
+            if (!popped) {
+                InterlockedExchange(&queue.consumerWaiting, 0);
+                popped = true;
+            }
+            // NOTE: Slots are only recycled after the generate thread hands
+            // them back, so this should never trigger.
+            CHECK(
+                workItem.chunk->generation == workItem.generation,
+                "stale generate work item"
+            );
+            auto chunk = workItem.chunk;
+            if (generateChunk(*workItem.vk, *chunk)) {
+                batch->chunks[batch->chunkCount++] = chunk;
             }
-            break;
-            case WAIT_TIMEOUT: FATAL("semaphore timeout");
-                // TODO: Call GetLastError here and FormatMessage for a more
-                // descriptive error message.
-            case WAIT_FAILED: FATAL("unknown error");
         }
+        if (batch && batch->chunkCount) {
+            generateDispatchBatch(vk, *batch);
+        }
+        if (popped) continue;
+
+        if (inFlight) {
+            InterlockedExchange(&queue.consumerWaiting, 0);
+            generateWaitForBatches(vk, generatePollTimeout);
+            continue;
+        }
+
+        // NOTE: Returns straight away if signal was bumped since we read it.
+        WaitOnAddress(&queue.signal, &signal, sizeof(signal), INFINITE);
     }
 }
 
-void initGenerate() {
-    generateWorkQueueMutex = CreateMutex(
-        nullptr,
-        false,
-        "generateWorkQueue"
+void initComputeRing(Vulkan& vk) {
+    auto& ring = computeRing;
+    initVKPipelineCompute(
+        vk,
+        "cs",
+        ring.pipeline
     );
-    CHECK(generateWorkQueueMutex, "Could not create mutex");
 
-    generateWorkSemaphore = CreateSemaphore(
-        nullptr,
-        0,
-        // TODO: bogus value for lMaximumCount.
-        1 < 10,
-        "generateWork"
+    // NOTE: The pipeline only comes with one descriptor set, so the slots
+    // allocate their own from a layout matching the bindings in cs.comp.
+    const u32 bindingCount = 4;
+    VkDescriptorSetLayoutBinding bindings[bindingCount] = {};
+    for (u32 i = 0; i < bindingCount; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
+    layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutCreateInfo.bindingCount = bindingCount;
+    layoutCreateInfo.pBindings = bindings;
+    VKCHECK(
+        vkCreateDescriptorSetLayout(
+            vk.device,
+            &layoutCreateInfo,
+            nullptr,
+            &ring.descriptorLayout
+        ),
+        "could not create compute descriptor set layout"
+    );
+
+    const u32 computeSlotCount = computeBatchCount * computeBatchSize;
+    VkDescriptorPoolSize poolSize = {};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = bindingCount * computeSlotCount;
+    VkDescriptorPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolCreateInfo.maxSets = computeSlotCount;
+    poolCreateInfo.poolSizeCount = 1;
+    poolCreateInfo.pPoolSizes = &poolSize;
+    VKCHECK(
+        vkCreateDescriptorPool(
+            vk.device,
+            &poolCreateInfo,
+            nullptr,
+            &ring.descriptorPool
+        ),
+        "could not create compute descriptor pool"
+    );
+
+    VkDescriptorSetLayout layouts[computeSlotCount];
+    VkDescriptorSet descriptorSets[computeSlotCount];
+    for (u32 i = 0; i < computeSlotCount; i++) {
+        layouts[i] = ring.descriptorLayout;
+    }
+    VkDescriptorSetAllocateInfo allocateInfo = {};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.descriptorPool = ring.descriptorPool;
+    allocateInfo.descriptorSetCount = computeSlotCount;
+    allocateInfo.pSetLayouts = layouts;
+    VKCHECK(
+        vkAllocateDescriptorSets(vk.device, &allocateInfo, descriptorSets),
+        "could not allocate compute descriptor sets"
     );
-    CHECK(generateWorkSemaphore, "Could not create semaphore");
+
+    for (u32 i = 0; i < computeSlotCount; i++) {
+        auto& batch = ring.batches[i / computeBatchSize];
+        auto& slot = batch.slots[i % computeBatchSize];
+        slot.descriptorSet = descriptorSets[i];
+        arenaAllocate(chunkDeviceArena, vk, computeScratchSize, slot.scratch);
+        arenaAllocate(chunkHostArena, vk, sizeof(ChunkStats), slot.stats);
+        bufferUpdateStorageRange(
+            vk,
+            slot.descriptorSet,
+            0,
+            slot.scratch.buffer,
+            slot.scratch.offset,
+            computeScratchVertexSize
+        );
+        bufferUpdateStorageRange(
+            vk,
+            slot.descriptorSet,
+            1,
+            slot.stats.buffer,
+            slot.stats.offset,
+            sizeof(ChunkStats)
+        );
+        bufferUpdateStorageRange(
+            vk,
+            slot.descriptorSet,
+            2,
+            slot.scratch.buffer,
+            slot.scratch.offset + computeScratchIndexOffset,
+            computeScratchIndexSize
+        );
+        bufferUpdateStorageRange(
+            vk,
+            slot.descriptorSet,
+            3,
+            slot.scratch.buffer,
+            slot.scratch.offset + computeScratchEdgeOffset,
+            computeScratchEdgeSize
+        );
+    }
+
+    if (gpuTimers.computeSupported) {
+        ring.timestamps = gpuTimerCreatePool(vk, computeBatchCount * 2);
+    }
+    for (auto& batch: ring.batches) {
+        batch.state = COMPUTE_BATCH_FREE;
+        batch.chunkCount = 0;
+        createCommandBuffers(vk.device, generateCmdPool, 1, &batch.cmd);
+        VkFenceCreateInfo fenceCreateInfo = {};
+        fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        VKCHECK(
+            vkCreateFence(vk.device, &fenceCreateInfo, nullptr, &batch.fence),
+            "could not create compute batch fence"
+        );
+    }
+}
+
+// Everything the meshes in the chunk cache depend on. 0 if the compute shader
+// can't be read.
+u64 generateHash() {
+    u64 hash = chunkCacheHashFile(0xcbf29ce484222325ull, "shaders/cs.comp.spv");
+    if (!hash) return 0;
+    u32 layout[] = {
+        chunkCacheVersion,
+        (u32)sizeof(Params),
+        (u32)sizeof(PackedVertex),
+        computeWidth,
+        computeHeight,
+        computeDepth,
+    };
+    return chunkCacheHashBytes(hash, layout, sizeof(layout));
+}
+
+void initGenerate(Vulkan& vk) {
+    VkCommandPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolCreateInfo.queueFamilyIndex = vk.computeQueueFamily;
+    VKCHECK(
+        vkCreateCommandPool(vk.device, &poolCreateInfo, nullptr, &generateCmdPool),
+        "could not create generate command pool"
+    );
+
+    const VkBufferUsageFlags arenaUsage =
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    initArena(
+        chunkDeviceArena,
+        vk,
+        "device",
+        arenaUsage,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    );
+    initArena(
+        chunkHostArena,
+        vk,
+        "host",
+        arenaUsage,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+    );
+    initComputeRing(vk);
+
+    for (u32 i = 0; i < generateWorkQueueSize; i++) {
+        generateWorkQueue.slots[i].sequence = i;
+    }
 
     CreateThread(
         nullptr,
         0,
         GenerateThread,
-        nullptr,
+        &vk,
         0,
         nullptr
     );
@@ -0,0 +1,183 @@
+// NOTE: GPU timestamps around the stages of a frame and around every compute
+// batch, so we can see how long the GPU itself spends on them rather than how
+// long the CPU waited. Every frame in flight has its own range of queries,
+// which is read back once the frame's fence has been waited on, so nothing
+// ever stalls on a query. Compute batches are read back the same way when
+// their fence is signaled, see generateCopyBatch.
+// Devices without timestampComputeAndGraphics are left untimed, and so are
+// queues whose family has no timestampValidBits.
+
+enum GpuStage {
+    GPU_STAGE_CULL,
+    GPU_STAGE_CHUNKS,
+    GPU_STAGE_TEXT,
+    GPU_STAGE_GRAPH,
+    GPU_STAGE_HIZ,
+    GPU_STAGE_COUNT,
+};
+
+const char* gpuStageNames[GPU_STAGE_COUNT] = {
+    "cull",
+    "chunks",
+    "text",
+    "graph",
+    "hiz",
+};
+
+struct GpuTimers {
+    bool supported;
+    // NOTE: Nanoseconds per tick.
+    float period;
+    // NOTE: The timestampValidBits of the graphics and the compute queue
+    // families. Only those bits of a timestamp count, the rest are undefined.
+    u64 frameMask;
+    u64 computeMask;
+    // NOTE: A begin and an end timestamp per stage, per frame in flight.
+    VkQueryPool framePool;
+    bool frameWritten[framesInFlight];
+    u32 frameSlot;
+    // NOTE: In ms. The last frame read back, for the overlay, and the sum of
+    // every frame read back, for the exit summary.
+    float stageTimes[GPU_STAGE_COUNT];
+    double stageTotals[GPU_STAGE_COUNT];
+    u32 framesTimed;
+    // NOTE: In ms, per compute batch. Written by the generate thread.
+    bool computeSupported;
+    float computeTime;
+    double computeTotal;
+    u32 batchesTimed;
+} gpuTimers;
+
+VkQueryPool gpuTimerCreatePool(Vulkan& vk, u32 queryCount) {
+    VkQueryPoolCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    createInfo.queryCount = queryCount;
+    VkQueryPool pool;
+    VKCHECK(
+        vkCreateQueryPool(vk.device, &createInfo, nullptr, &pool),
+        "could not create timestamp query pool"
+    );
+    return pool;
+}
+
+// Returns a mask of the bits a queue family's timestamps are valid in, 0 if
+// it can't write them.
+u64 gpuTimerValidMask(Vulkan& vk, u32 queueFamily) {
+    u32 familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(vk.gpu, &familyCount, nullptr);
+    vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(vk.gpu, &familyCount, families.data());
+    CHECK(queueFamily < familyCount, "queue family out of range");
+    u32 bits = families[queueFamily].timestampValidBits;
+    if (bits >= 64) return ~0ull;
+    return (1ull << bits) - 1;
+}
+
+// Reads pairCount pairs of begin and end timestamps and writes the time
+// between each pair to times, in ms. Only the bits in validMask are compared.
+// Returns false without waiting if any of them aren't available yet.
+bool gpuTimerRead(
+    Vulkan& vk,
+    VkQueryPool pool,
+    u32 firstQuery,
+    u32 pairCount,
+    u64 validMask,
+    float* times
+) {
+    u64 timestamps[GPU_STAGE_COUNT * 2];
+    CHECK(pairCount <= GPU_STAGE_COUNT, "too many timestamps to read");
+    auto result = vkGetQueryPoolResults(
+        vk.device,
+        pool,
+        firstQuery,
+        pairCount * 2,
+        pairCount * 2 * sizeof(u64),
+        timestamps,
+        sizeof(u64),
+        VK_QUERY_RESULT_64_BIT
+    );
+    if (result != VK_SUCCESS) return false;
+    for (u32 i = 0; i < pairCount; i++) {
+        u64 begin = timestamps[i * 2] & validMask;
+        u64 end = timestamps[i * 2 + 1] & validMask;
+        u64 ticks = (end - begin) & validMask;
+        times[i] = (float)((double)ticks * gpuTimers.period / (1000 * 1000));
+    }
+    return true;
+}
+
+// Reads back the timestamps the frame slot was last recorded with and resets
+// them. Record at the start of the frame, after waiting for its fence.
+void gpuTimerBeginFrame(Vulkan& vk, VkCommandBuffer cmd, u32 frameSlot) {
+    if (!gpuTimers.supported) return;
+    gpuTimers.frameSlot = frameSlot;
+    u32 firstQuery = frameSlot * GPU_STAGE_COUNT * 2;
+
+    float times[GPU_STAGE_COUNT];
+    if (gpuTimers.frameWritten[frameSlot] &&
+            gpuTimerRead(
+                vk,
+                gpuTimers.framePool,
+                firstQuery,
+                GPU_STAGE_COUNT,
+                gpuTimers.frameMask,
+                times
+            )) {
+        for (u32 i = 0; i < GPU_STAGE_COUNT; i++) {
+            gpuTimers.stageTimes[i] = times[i];
+            gpuTimers.stageTotals[i] += times[i];
+        }
+        gpuTimers.framesTimed++;
+    }
+
+    vkCmdResetQueryPool(cmd, gpuTimers.framePool, firstQuery, GPU_STAGE_COUNT * 2);
+    gpuTimers.frameWritten[frameSlot] = true;
+}
+
+// NOTE: Every stage has to be both begun and ended every frame, or none of
+// the frame's timestamps can be read back.
+void gpuTimerBeginStage(VkCommandBuffer cmd, GpuStage stage) {
+    if (!gpuTimers.supported) return;
+    u32 query = (gpuTimers.frameSlot * GPU_STAGE_COUNT + stage) * 2;
+    vkCmdWriteTimestamp(
+        cmd,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        gpuTimers.framePool,
+        query
+    );
+}
+
+void gpuTimerEndStage(VkCommandBuffer cmd, GpuStage stage) {
+    if (!gpuTimers.supported) return;
+    u32 query = (gpuTimers.frameSlot * GPU_STAGE_COUNT + stage) * 2 + 1;
+    vkCmdWriteTimestamp(
+        cmd,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        gpuTimers.framePool,
+        query
+    );
+}
+
+void initGpuTimers(Vulkan& vk) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(vk.gpu, &properties);
+    gpuTimers.period = properties.limits.timestampPeriod;
+    gpuTimers.frameMask = gpuTimerValidMask(vk, vk.queueFamily);
+    gpuTimers.computeMask = gpuTimerValidMask(vk, vk.computeQueueFamily);
+    gpuTimers.supported = properties.limits.timestampComputeAndGraphics &&
+        gpuTimers.frameMask;
+    gpuTimers.computeSupported = properties.limits.timestampComputeAndGraphics &&
+        gpuTimers.computeMask;
+    if (properties.limits.timestampComputeAndGraphics && !gpuTimers.computeMask) {
+        INFO("Compute queue timestamps not supported, compute batches won't be timed");
+    }
+    if (!gpuTimers.supported) {
+        INFO("Timestamps not supported, GPU times won't be measured");
+        return;
+    }
+    gpuTimers.framePool = gpuTimerCreatePool(
+        vk,
+        framesInFlight * GPU_STAGE_COUNT * 2
+    );
+}
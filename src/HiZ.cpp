@@ -0,0 +1,189 @@
+// NOTE: Hierarchical depth buffer for occlusion culling. We can't sample the
+// swap chain's depth attachment, so default.frag writes each fragment's depth
+// into the first level of pyramid with atomicMin instead. After the render
+// pass, shaders/hiz.comp reduces it into smaller levels that keep the furthest
+// depth of what they cover. The next frame's cull pass tests chunk AABBs
+// against it with the view the depth was rendered from. Chunks revealed by
+// camera motion show up a frame late.
+// Needs the fragmentStoresAndAtomics device feature. Without it, or with Hi-Z
+// turned off, chunks are drawn with defaultNoHiZ.frag, which has no pyramid.
+
+const u32 hizMaxLevels = 16;
+
+struct HiZLevel {
+    // NOTE: In depths, after the header.
+    u32 offset;
+    u32 width;
+    u32 height;
+    u32 padding;
+};
+
+// NOTE: Must match the header of DepthPyramid in the shaders.
+struct HiZHeader {
+    u32 width;
+    u32 height;
+    u32 enabled;
+    u32 padding;
+};
+
+struct HiZ {
+    VulkanPipeline pipeline;
+    // NOTE: A HiZHeader followed by every level. In chunkDeviceArena.
+    ArenaAllocation pyramid;
+    HiZHeader header;
+    HiZLevel levels[hizMaxLevels];
+    u32 levelCount;
+    // NOTE: Set once a pyramid has been built, along with the view it was
+    // rendered from.
+    bool built;
+    Vec4 eye;
+    Quaternion rotation;
+} hiz;
+
+// Clears the first level for this frame's fragments. Record after the cull
+// pass, which reads the last frame's pyramid, and before the render pass.
+void hizBeginFrame(VkCommandBuffer cmd) {
+    bufferBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0
+    );
+    vkCmdUpdateBuffer(
+        cmd,
+        hiz.pyramid.buffer,
+        hiz.pyramid.offset,
+        sizeof(HiZHeader),
+        &hiz.header
+    );
+    if (hiz.header.enabled) {
+        // NOTE: The bits of 1.f, the far plane.
+        auto& level = hiz.levels[0];
+        vkCmdFillBuffer(
+            cmd,
+            hiz.pyramid.buffer,
+            hiz.pyramid.offset + sizeof(HiZHeader) + level.offset * sizeof(u32),
+            level.width * level.height * sizeof(u32),
+            0x3f800000
+        );
+    }
+    bufferBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+    );
+}
+
+// Reduces this frame's depths into the rest of the pyramid. Record after the
+// render pass.
+void hizBuild(VkCommandBuffer cmd, Vec4& eye, Quaternion& rotation) {
+    if (!hiz.header.enabled) return;
+
+    bufferBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+    );
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, hiz.pipeline.handle);
+    vkCmdBindDescriptorSets(
+        cmd,
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        hiz.pipeline.layout,
+        0, 1, &hiz.pipeline.descriptorSet,
+        0, nullptr
+    );
+    const u32 groupSize = 8;
+    for (u32 i = 1; i < hiz.levelCount; i++) {
+        HiZLevel params[2] = { hiz.levels[i - 1], hiz.levels[i] };
+        vkCmdPushConstants(
+            cmd,
+            hiz.pipeline.layout,
+            VK_SHADER_STAGE_COMPUTE_BIT,
+            0, sizeof(params), params
+        );
+        vkCmdDispatch(
+            cmd,
+            (params[1].width + groupSize - 1) / groupSize,
+            (params[1].height + groupSize - 1) / groupSize,
+            1
+        );
+        // NOTE: The last one makes the pyramid visible to the next frame's
+        // cull pass.
+        bufferBarrier(
+            cmd,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+        );
+    }
+
+    hiz.built = true;
+    hiz.eye = eye;
+    hiz.rotation = rotation;
+}
+
+void initHiZ(
+    Vulkan& vk,
+    VulkanPipeline& pipeline,
+    u32 width,
+    u32 height,
+    bool enabled
+) {
+    u32 offset = 0;
+    u32 levelWidth = width;
+    u32 levelHeight = height;
+    for (hiz.levelCount = 0; hiz.levelCount < hizMaxLevels; hiz.levelCount++) {
+        auto& level = hiz.levels[hiz.levelCount];
+        level.offset = offset;
+        level.width = levelWidth;
+        level.height = levelHeight;
+        offset += levelWidth * levelHeight;
+        if ((levelWidth == 1) && (levelHeight == 1)) {
+            hiz.levelCount++;
+            break;
+        }
+        levelWidth = (levelWidth + 1) / 2;
+        levelHeight = (levelHeight + 1) / 2;
+    }
+    hiz.header.width = width;
+    hiz.header.height = height;
+    hiz.header.enabled = enabled;
+
+    arenaAllocate(
+        chunkDeviceArena,
+        vk,
+        sizeof(HiZHeader) + offset * sizeof(u32),
+        hiz.pyramid
+    );
+    // NOTE: Only default.frag has the pyramid.
+    if (enabled) {
+        bufferUpdateStorageRange(
+            vk,
+            pipeline.descriptorSet,
+            2,
+            hiz.pyramid.buffer,
+            hiz.pyramid.offset,
+            hiz.pyramid.size
+        );
+    }
+
+    initVKPipelineCompute(
+        vk,
+        "hiz",
+        hiz.pipeline
+    );
+    bufferUpdateStorageRange(
+        vk,
+        hiz.pipeline.descriptorSet,
+        0,
+        hiz.pyramid.buffer,
+        hiz.pyramid.offset,
+        hiz.pyramid.size
+    );
+}
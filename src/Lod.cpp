@@ -0,0 +1,252 @@
+// NOTE: Level of detail. The world is covered by roots of lodRootLevel, each
+// lodRootSize level 0 chunks wide, and the roots within lodRootRange of the
+// eye's are split like an octree: a node is split into 8 chunks of the level
+// below while the eye is closer than its own width, measured along the
+// furthest axis. That keeps neighbouring chunks at most one level apart.
+// Chunks that meet a coarser neighbour are meshed with transitions on that
+// face (see ChunkFace and cs.comp), so the same coord and level can need a
+// different mesh as the camera moves.
+// Chunks that aren't generated yet are drawn with whatever covers the same
+// space: the same chunk with other transitions, the chunk above or the 8 below
+// it. Chunks known to have no surface cover their space with nothing.
+// Only touched by the render thread.
+
+const u32 lodRootLevel = chunkTreeLevels;
+const i32 lodRootSize = 1 << lodRootLevel;
+const i32 lodRootRange = 2;
+const u32 lodLevelCount = lodRootLevel + 1;
+
+struct LodRequest {
+    Vec3i coord;
+    u32 level;
+    u32 transitions;
+};
+
+struct Lod {
+    // NOTE: In roots.
+    Vec3i rootMin;
+    Vec3i rootMax;
+    // NOTE: Every chunk the selection wants, nearest roots first.
+    vector<LodRequest> wanted;
+    // NOTE: The chunks in the chunk tree.
+    vector<ChunkHandle> drawn;
+    vector<Chunk*> picked;
+    u64 frame;
+    // NOTE: Per frame, for the overlay.
+    u32 levelCounts[lodLevelCount];
+    u32 standIns;
+} lod;
+
+// Fills in the roots around the eye and returns the region chunks are kept
+// resident in, in level 0 chunks.
+void lodRegion(Vec4& eye, Vec3i& regionMin, Vec3i& regionMax) {
+    float rootWidth = (float)(computeWidth << lodRootLevel);
+    Vec3i root = {
+        (i32)floorf(eye.x / rootWidth),
+        (i32)floorf(eye.y / rootWidth),
+        (i32)floorf(eye.z / rootWidth)
+    };
+    lod.rootMin = {
+        root.x - lodRootRange,
+        root.y - lodRootRange,
+        root.z - lodRootRange
+    };
+    lod.rootMax = {
+        root.x + lodRootRange,
+        root.y + lodRootRange,
+        root.z + lodRootRange
+    };
+    regionMin = {
+        lod.rootMin.x * lodRootSize,
+        lod.rootMin.y * lodRootSize,
+        lod.rootMin.z * lodRootSize
+    };
+    regionMax = {
+        (lod.rootMax.x + 1) * lodRootSize - 1,
+        (lod.rootMax.y + 1) * lodRootSize - 1,
+        (lod.rootMax.z + 1) * lodRootSize - 1
+    };
+}
+
+bool lodInRange(Vec3i& coord, u32 level) {
+    // NOTE: Arithmetic shifts, so negative coordinates round down.
+    u32 shift = lodRootLevel - level;
+    i32 x = coord.x >> shift;
+    i32 y = coord.y >> shift;
+    i32 z = coord.z >> shift;
+    return (x >= lod.rootMin.x) && (x <= lod.rootMax.x) &&
+        (y >= lod.rootMin.y) && (y <= lod.rootMax.y) &&
+        (z >= lod.rootMin.z) && (z <= lod.rootMax.z);
+}
+
+bool lodSplit(Vec3i& coord, u32 level, Vec3& eye) {
+    if (!level) return false;
+    float size = (float)(computeWidth << level);
+    float e[3] = { eye.x, eye.y, eye.z };
+    i32 c[3] = { coord.x, coord.y, coord.z };
+    float distance = 0;
+    for (u32 i = 0; i < 3; i++) {
+        float lo = c[i] * size;
+        float d = fmaxf(fmaxf(lo - e[i], e[i] - (lo + size)), 0.f);
+        distance = fmaxf(distance, d);
+    }
+    return distance < size;
+}
+
+// The ChunkFace bits of the faces whose neighbour is a coarser chunk.
+u32 lodTransitions(Vec3i& coord, u32 level, Vec3& eye) {
+    u32 transitions = 0;
+    for (u32 face = 0; face < 6; face++) {
+        i32 step = (face & 1) ? 1 : -1;
+        Vec3i neighbour = coord;
+        if (face / 2 == 0) neighbour.x += step;
+        if (face / 2 == 1) neighbour.y += step;
+        if (face / 2 == 2) neighbour.z += step;
+        if (!lodInRange(neighbour, level)) continue;
+
+        // NOTE: The neighbour is coarser if any of its ancestors isn't split.
+        for (u32 ancestorLevel = lodRootLevel; ancestorLevel > level; ancestorLevel--) {
+            u32 shift = ancestorLevel - level;
+            Vec3i ancestor = {
+                neighbour.x >> shift,
+                neighbour.y >> shift,
+                neighbour.z >> shift
+            };
+            if (!lodSplit(ancestor, ancestorLevel, eye)) {
+                transitions |= 1 << face;
+                break;
+            }
+        }
+    }
+    return transitions;
+}
+
+// Whether the selection would pick exactly this chunk from the eye.
+bool lodWanted(Chunk* chunk, Vec3& eye) {
+    if (!lodInRange(chunk->coord, chunk->level)) return false;
+    if (lodSplit(chunk->coord, chunk->level, eye)) return false;
+    if (chunk->level < lodRootLevel) {
+        Vec3i parent = {
+            chunk->coord.x >> 1,
+            chunk->coord.y >> 1,
+            chunk->coord.z >> 1
+        };
+        if (!lodSplit(parent, chunk->level + 1, eye)) return false;
+    }
+    return chunk->transitions == lodTransitions(chunk->coord, chunk->level, eye);
+}
+
+Vec3i lodChild(Vec3i& coord, u32 childIdx) {
+    return {
+        coord.x * 2 + (i32)(childIdx & 1),
+        coord.y * 2 + (i32)((childIdx >> 1) & 1),
+        coord.z * 2 + (i32)((childIdx >> 2) & 1)
+    };
+}
+
+// Picks what to draw for the node. Returns false if part of it is left
+// uncovered.
+bool lodVisit(Vec3i coord, u32 level, Vec3& eye) {
+    auto& picked = lod.picked;
+    if (lodSplit(coord, level, eye)) {
+        u32 mark = (u32)picked.size();
+        bool covered = true;
+        // NOTE: Visit every child even once there's a hole, so all of them
+        // still get requested.
+        for (u32 i = 0; i < 8; i++) {
+            covered &= lodVisit(lodChild(coord, i), level - 1, eye);
+        }
+        if (covered) return true;
+
+        auto standIn = chunkMapFindResident(coord, level);
+        if (!standIn) return false;
+        picked.resize(mark);
+        picked.push_back(standIn);
+        lod.standIns++;
+        return true;
+    }
+
+    lod.levelCounts[level]++;
+    u32 transitions = lodTransitions(coord, level, eye);
+    if (residencyKnownEmpty(coord, level, transitions)) return true;
+    lod.wanted.push_back({ coord, level, transitions });
+
+    auto chunk = chunkMapFind(coord, level, transitions);
+    if (chunk && (chunk->state == CHUNK_RESIDENT)) {
+        picked.push_back(chunk);
+        return true;
+    }
+    auto standIn = chunkMapFindResident(coord, level);
+    if (standIn) {
+        picked.push_back(standIn);
+        lod.standIns++;
+        return true;
+    }
+    if (!level) return false;
+
+    u32 mark = (u32)picked.size();
+    for (u32 i = 0; i < 8; i++) {
+        auto child = chunkMapFindResident(lodChild(coord, i), level - 1);
+        if (!child) {
+            picked.resize(mark);
+            return false;
+        }
+        picked.push_back(child);
+    }
+    lod.standIns++;
+    return true;
+}
+
+// Picks the chunks to draw this frame and swaps them into the chunk tree.
+// Fills lod.wanted with the chunks that should be generated. Call after
+// lodRegion.
+void lodUpdate(Vec4& eye4) {
+    Vec3 eye = { eye4.x, eye4.y, eye4.z };
+    lod.frame++;
+    lod.wanted.clear();
+    lod.picked.clear();
+    lod.standIns = 0;
+    for (auto& count: lod.levelCounts) count = 0;
+
+    // NOTE: Nearest roots first, so they're requested first when the pool
+    // runs out of slots.
+    Vec3i eyeRoot = {
+        (lod.rootMin.x + lod.rootMax.x) / 2,
+        (lod.rootMin.y + lod.rootMax.y) / 2,
+        (lod.rootMin.z + lod.rootMax.z) / 2
+    };
+    for (i32 ring = 0; ring <= lodRootRange; ring++) {
+        for (i32 x = -ring; x <= ring; x++) {
+            for (i32 y = -ring; y <= ring; y++) {
+                for (i32 z = -ring; z <= ring; z++) {
+                    if ((abs(x) != ring) && (abs(y) != ring) && (abs(z) != ring)) {
+                        continue;
+                    }
+                    Vec3i root = { eyeRoot.x + x, eyeRoot.y + y, eyeRoot.z + z };
+                    lodVisit(root, lodRootLevel, eye);
+                }
+            }
+        }
+    }
+
+    // NOTE: Take the chunks that are no longer picked out of the tree before
+    // putting the new ones in, so the tree never holds overlapping chunks.
+    for (auto chunk: lod.picked) chunk->lodFrame = lod.frame;
+    for (auto handle: lod.drawn) {
+        auto chunk = residencyResolve(handle);
+        if (!chunk || (chunk->lodFrame == lod.frame)) continue;
+        chunkTreeRemove(chunk);
+        chunk->drawn = false;
+        residencyTouch(chunk);
+        residencyChanged(chunk);
+    }
+    lod.drawn.clear();
+    for (auto chunk: lod.picked) {
+        if (!chunk->drawn) {
+            chunk->drawn = true;
+            if (chunk->indexCount) chunkTreeInsert(chunk);
+            residencyChanged(chunk);
+        }
+        lod.drawn.push_back(residencyHandle(chunk));
+    }
+}
@@ -2,6 +2,7 @@
 
 #include <cstdio>
 #include <cstdint>
+#include <cstring>
 
 #include "jcwk/Logging.h"
 #include "jcwk/MathLib.cpp"
@@ -12,6 +13,12 @@ struct Vertex {
     Vec4 position;
     Vec4 normal;
 };
+// NOTE: What chunks are actually drawn with. Vertex is only used while
+// meshing. See packVertex and shaders/vertex.glsl.
+struct PackedVertex {
+    u32 positionXY;
+    u32 positionZNormal;
+};
 struct Uniforms {
     float proj[16];
     float ortho[16];
@@ -46,9 +53,32 @@ struct Uniforms {
 #endif
 
 #include "jcwk/Timer.h"
+
+// NOTE: Frames the CPU may record ahead of the GPU. Anything written by the
+// CPU every frame needs this many copies.
+const u32 framesInFlight = 2;
+
 #include "Text.cpp"
 #include "PerfGraph.cpp"
+#include "Cpu.cpp"
+#include "ThreadPool.cpp"
+#include "Noise.cpp"
+#include "MarchingCubes.cpp"
+#include "CpuMesher.cpp"
+#include "DeviceFeatures.cpp"
+#include "Buffers.cpp"
+#include "GpuTimers.cpp"
+#include "Arena.cpp"
+#include "ChunkCache.cpp"
 #include "Generation.cpp"
+#include "ChunkMap.cpp"
+#include "Culling.cpp"
+#include "ChunkTree.cpp"
+#include "Residency.cpp"
+#include "Lod.cpp"
+#include "Scheduler.cpp"
+#include "HiZ.cpp"
+#include "DrawList.cpp"
 
 const float DELTA_MOVE_PER_S = 10.f;
 const float MOUSE_SENSITIVITY = 0.1f;
@@ -158,26 +188,104 @@ WinMain(
     }
 
     // Initialize Vulkan.
+    initDeviceFeatures(vk);
     initVK(vk);
     INFO("Vulkan initialized")
 
+    initCpu();
+    // NOTE: Leave a core each for the render and generate threads.
+    initPool((cpu.coreCount > 3) ? cpu.coreCount - 2 : 1);
+    initNoise();
     initText(vk);
     graphInit(vk);
-    initGenerate();
+    initGpuTimers(vk);
+    if (strstr(commandLine, "-cpu")) {
+        generateBackend = GENERATE_BACKEND_CPU;
+    } else if (strstr(commandLine, "-hybrid")) {
+        generateBackend = GENERATE_BACKEND_HYBRID;
+    }
+    if (strstr(commandLine, "-pack-compare")) {
+        packCompare = true;
+    }
+    if (strstr(commandLine, "-cull-bench")) {
+        cullBenchmark();
+    }
+    if (strstr(commandLine, "-chunk-map-check")) {
+        chunkMapCheck();
+    }
+    // NOTE: In world units, 0 draws everything in view.
+    float drawDistance = 512.f;
+    {
+        auto arg = strstr(commandLine, "-draw-distance ");
+        if (arg) {
+            drawDistance = (float)atof(arg + strlen("-draw-distance "));
+        }
+    }
+    initGenerate(vk);
+    initChunkCache(generateHash(), !strstr(commandLine, "-no-cache"));
+    // NOTE: Enough to keep every pool worker and the GPU busy, few enough that
+    // stale chunks can still be cancelled.
+    initScheduler(pool.workerCount + 2);
+
+    // NOTE: The slot pool has a fixed size, but slots are recycled as the
+    // camera moves so the world can grow without bound.
+    initResidency(1 << 11);
+
+    // Setup frames in flight.
+    struct Frame {
+        VkCommandBuffer cmd;
+        VkFence done;
+        VkSemaphore imageReady;
+        VkSemaphore renderDone;
+    };
+    Frame frames[framesInFlight] = {};
+    VkCommandPool frameCmdPool;
+    {
+        VkCommandPoolCreateInfo poolCreateInfo = {};
+        poolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolCreateInfo.queueFamilyIndex = vk.queueFamily;
+        VKCHECK(
+            vkCreateCommandPool(vk.device, &poolCreateInfo, nullptr, &frameCmdPool),
+            "could not create frame command pool"
+        );
 
-    // FIXME: This has a static size at the moment which is not optimal because
-    // ideally we'd like to have an infinitely expanding world. The reason it
-    // can't arbitrarily expand is because that relocates some of the pointers
-    // used in the threads spawned by the generation code.
-    u32 nextChunkIdx = 0;
-    vector<Chunk> chunks(1 << 10);
+        VkFenceCreateInfo fenceCreateInfo = {};
+        fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+        VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+        semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        for (auto& frame: frames) {
+            createCommandBuffers(vk.device, frameCmdPool, 1, &frame.cmd);
+            VKCHECK(
+                vkCreateFence(vk.device, &fenceCreateInfo, nullptr, &frame.done),
+                "could not create frame fence"
+            );
+            VKCHECK(
+                vkCreateSemaphore(vk.device, &semaphoreCreateInfo, nullptr, &frame.imageReady),
+                "could not create frame semaphore"
+            );
+            VKCHECK(
+                vkCreateSemaphore(vk.device, &semaphoreCreateInfo, nullptr, &frame.renderDone),
+                "could not create frame semaphore"
+            );
+        }
+    }
 
     // Setup pipelines.
     VulkanPipeline defaultPipeline;
     {
+        // NOTE: The cull pass leaves the draw to find the chunk with
+        // firstInstance.
+        bool gpuCull = deviceFeatures.drawIndirectFirstInstance &&
+            !strstr(commandLine, "-no-gpu-cull");
+        // NOTE: Only the cull pass reads the depth pyramid.
+        bool hizEnabled = gpuCull &&
+            deviceFeatures.fragmentStoresAndAtomics &&
+            !strstr(commandLine, "-no-hiz");
         initVKPipeline(
             vk,
-            "default",
+            hizEnabled ? "default" : "defaultNoHiZ",
             defaultPipeline
         );
         updateUniformBuffer(
@@ -186,16 +294,23 @@ WinMain(
             0,
             vk.uniforms.handle
         );
+        initHiZ(
+            vk,
+            defaultPipeline,
+            vk.swap.extent.width,
+            vk.swap.extent.height,
+            hizEnabled
+        );
+        initDrawList(
+            vk,
+            defaultPipeline,
+            (u32)residency.chunks.size(),
+            deviceFeatures.multiDrawIndirect && !strstr(commandLine, "-no-mdi"),
+            deviceFeatures.drawIndirectFirstInstance,
+            !gpuCull
+        );
     }
 
-    // Generate first chunk.
-    GenerateWorkItem workItem = {};
-    workItem.vk = &vk;
-    workItem.coord = {0, 0, 0};
-    workItem.chunk = &chunks[0];
-    nextChunkIdx++;
-    generatePushWorkItem(workItem);
-
     // Initialize DirectInput.
     DirectInput directInput(instance);
     auto mouse = directInput.mouse;
@@ -217,6 +332,8 @@ WinMain(
         screenHeight,
         uniforms.ortho
     );
+    // NOTE: Only written once, since every frame in flight reads it. The eye
+    // and rotation are pushed as constants each frame instead.
     updateUniforms(vk, &uniforms, sizeof(uniforms));
 
     // Main loop.
@@ -233,9 +350,20 @@ WinMain(
     u32 frameTimeIdx = 0;
     BOOL done = false;
     int errorCode = 0;
+    u32 frameSlot = 0;
     while (!done) {
         QueryPerformanceCounter(&frameStart);
 
+        // NOTE: Wait until the GPU is done with the last frame that used this
+        // slot before touching anything of it.
+        auto& frame = frames[frameSlot];
+        vkWaitForFences(
+            vk.device,
+            1, &frame.done,
+            VK_TRUE,
+            std::numeric_limits<uint64_t>::max()
+        );
+
         MSG msg;
         BOOL messageAvailable; 
         do {
@@ -257,51 +385,29 @@ WinMain(
         currentChunkCoord.y = (i32)floor(uniforms.eye.y / computeHeight);
         currentChunkCoord.z = (i32)floor(uniforms.eye.z / computeDepth);
 
-        vector<Vec3i> requestedChunkCoords;
+        // NOTE: Request what the level of detail wants after it picked what
+        // to draw, so making room never evicts a chunk it is drawing.
         {
-            const i32 range = 4;
-            const i32 coordCount = (range+1)*(range+1)*(range+1);
-            requestedChunkCoords.resize(coordCount);
-
-            u32 i = 0;
-            const i32 rangeMin = 0 - range/2;
-            const i32 rangeMax = 0 + range/2;
-            for (i32 x = rangeMin; x <= rangeMax; x++) {
-                for (i32 y = rangeMin; y <= rangeMax; y++) {
-                    for (i32 z = rangeMin; z <= rangeMax; z++) {
-                        auto& coord = requestedChunkCoords[i];
-                        coord.x = currentChunkCoord.x + x;
-                        coord.y = currentChunkCoord.y + y;
-                        coord.z = currentChunkCoord.z + z;
-                        i++;
-                    }
+            Vec3i regionMin = {};
+            Vec3i regionMax = {};
+            lodRegion(uniforms.eye, regionMin, regionMax);
+            residencyUpdate(vk, regionMin, regionMax);
+            lodUpdate(uniforms.eye);
+            for (auto& request: lod.wanted) {
+                if (chunkMapFind(request.coord, request.level, request.transitions)) {
+                    continue;
                 }
+                auto chunk = residencyAllocate();
+                if (!chunk) break;
+                schedulerRequest(chunk, request.coord, request.level, request.transitions);
             }
         }
 
-        vector<Vec3i> chunksToGenerate;
-        for (auto& coord: requestedChunkCoords) {
-            bool chunkAvailable = false;
-
-            for (auto& chunk: chunks) {
-                // FIXME: this search is probably kinda slow.
-                if (vectorEquals(chunk.coord, coord)) {
-                    chunkAvailable = true;
-                    break;
-                }
-            }
-
-            if (!chunkAvailable) {
-                auto& chunk = chunks[nextChunkIdx];
-                chunk.coord = coord;
-                nextChunkIdx++;
-
-                GenerateWorkItem workItem = {};
-                workItem.vk = &vk;
-                workItem.coord = coord;
-                workItem.chunk = &chunk;
-                generatePushWorkItem(workItem);
-            }
+        {
+            Vec3 eye = { uniforms.eye.x, uniforms.eye.y, uniforms.eye.z };
+            Vec3 forward = {};
+            moveAlongQuaternion(1.f, uniforms.rotation, forward);
+            schedulerUpdate(vk, eye, forward);
         }
 
         // Acquire swap image.
@@ -310,7 +416,7 @@ WinMain(
             vk.device,
             vk.swap.handle,
             std::numeric_limits<uint64_t>::max(),
-            vk.swap.imageReady,
+            frame.imageReady,
             VK_NULL_HANDLE,
             &swapImageIndex
         );
@@ -323,12 +429,27 @@ WinMain(
         }
 
         // Render.
-        auto drawCallCount = 0;
-        auto drawnVertexCount = 0;
-        VkCommandBuffer cmd;
+        VkCommandBuffer cmd = frame.cmd;
         {
-            createCommandBuffers(vk.device, vk.cmdPool, 1, &cmd);
+            VKCHECK(vkResetCommandBuffer(cmd, 0));
             beginFrameCommandBuffer(cmd);
+            gpuTimerBeginFrame(vk, cmd, frameSlot);
+            residencyTransfer(vk, cmd);
+
+            // NOTE: Drawn chunks are culled one by one on the GPU, or on the
+            // CPU after the chunk tree drops whole regions that are out of
+            // view or range. See DrawList.cpp and ChunkTree.cpp.
+            drawListBegin(frameSlot);
+            drawListSetView(
+                uniforms.proj,
+                uniforms.eye,
+                uniforms.rotation,
+                drawDistance
+            );
+            gpuTimerBeginStage(cmd, GPU_STAGE_CULL);
+            drawListCull(cmd);
+            gpuTimerEndStage(cmd, GPU_STAGE_CULL);
+            hizBeginFrame(cmd);
 
             VkClearValue colorClear;
             colorClear.color = {};
@@ -352,7 +473,6 @@ WinMain(
                 VK_PIPELINE_BIND_POINT_GRAPHICS,
                 defaultPipeline.handle
             );
-            VkDeviceSize offsets[] = {0};
             vkCmdBindDescriptorSets(
                 cmd,
                 VK_PIPELINE_BIND_POINT_GRAPHICS,
@@ -361,75 +481,29 @@ WinMain(
                 &defaultPipeline.descriptorSet,
                 0, nullptr
             );
-            for (u32 chunkIdx = 0; chunkIdx < nextChunkIdx; chunkIdx++) {
-                auto& chunk = chunks[chunkIdx];
-                if (chunk.vertexCount) {
-                    Vec3 corners[8] = {
-                        { chunk.min.x, chunk.min.y, chunk.min.z },
-                        { chunk.min.x, chunk.min.y, chunk.max.z },
-                        { chunk.min.x, chunk.max.y, chunk.min.z },
-                        { chunk.min.x, chunk.max.y, chunk.max.z },
-                        { chunk.max.x, chunk.min.y, chunk.min.z },
-                        { chunk.max.x, chunk.min.y, chunk.max.z },
-                        { chunk.max.x, chunk.max.y, chunk.min.z },
-                        { chunk.max.x, chunk.max.y, chunk.max.z }
-                    };
-                    Vec3 eye = { -uniforms.eye.x, -uniforms.eye.y, -uniforms.eye.z };
-                    bool insideViewFrustum = false;
-                    float minX = INFINITY;
-                    float maxX = -INFINITY;
-                    float minY = INFINITY;
-                    float maxY = -INFINITY;
-                    for (auto& corner: corners) {
-                        vectorAdd(corner, eye, corner);
-                        rotatePoint(uniforms.rotation, corner, corner);
-                        Vec4 r = {};
-                        matrixMultiplyPoint(uniforms.proj, corner, r);
-                        if (r.z >= 0) {
-                            insideViewFrustum = true;
-                        }
-                        float x = r.x / r.w;
-                        float y = r.y / r.w;
-                        minX = fmin(minX, x);
-                        maxX = fmax(maxX, x);
-                        minY = fmin(minY, y);
-                        maxY = fmax(maxY, y);
-                    }
-                    if (!insideViewFrustum) continue;
-                    else {
-                        if ((minX < -1) && (maxX < -1)) {
-                            insideViewFrustum = false;
-                        } else if ((minX > 1) && (maxX > 1)) {
-                            insideViewFrustum = false;
-                        } else if ((minY < -1) && (maxY < -1)) {
-                            insideViewFrustum = false;
-                        } else if ((minY > 1) && (maxY > 1)) {
-                            insideViewFrustum = false;
-                        } else {
-                            insideViewFrustum = true;
-                        }
-                    }
-                    if (!insideViewFrustum) continue;
-
-                    drawCallCount++;
-                    drawnVertexCount += chunk.vertexCount;
-                    vkCmdBindVertexBuffers(
-                        cmd,
-                        0, 1,
-                        &chunk.vertexBuffer.handle,
-                        offsets
-                    );
-                    vkCmdDraw(
-                        cmd,
-                        chunk.vertexCount,
-                        1,
-                        0,
-                        0
-                    );
-                }
-            }
+            // NOTE: The origin is left 0 for draws to pick from origins,
+            // see DrawList.cpp.
+            Vec4 view[3] = {
+                uniforms.eye,
+                {
+                    uniforms.rotation.x,
+                    uniforms.rotation.y,
+                    uniforms.rotation.z,
+                    uniforms.rotation.w
+                },
+                {}
+            };
+            vkCmdPushConstants(
+                cmd,
+                defaultPipeline.layout,
+                VK_SHADER_STAGE_VERTEX_BIT,
+                0, sizeof(view), view
+            );
+            gpuTimerBeginStage(cmd, GPU_STAGE_CHUNKS);
+            drawListRecord(cmd, defaultPipeline.layout);
+            gpuTimerEndStage(cmd, GPU_STAGE_CHUNKS);
 
-            startText();
+            startText(frameSlot);
             display("%.4fms (%.2f Hz)", frameTime * 1000, 1.f / frameTime);
             display("%.4fms (%.2f Hz)", averageFrameTime * 1000, 1.f / averageFrameTime);
             display(
@@ -437,13 +511,59 @@ WinMain(
                 uniforms.eye.x, uniforms.eye.y, uniforms.eye.z
             );
             display(
-                "%dx %dy %dz (%d chunks)",
-                currentChunkCoord.x, currentChunkCoord.y, currentChunkCoord.z, nextChunkIdx
+                "%dx %dy %dz (%d chunks, %.2fMB)",
+                currentChunkCoord.x, currentChunkCoord.y, currentChunkCoord.z,
+                residency.residentCount,
+                (float)residency.residentBytes / (1024 * 1024)
+            );
+            display(
+                "%d chunks (%d occluded), %d vertices, %d indices visible in %d calls",
+                drawList.visibleChunks,
+                drawList.occludedChunks,
+                drawList.visibleVertices,
+                drawList.visibleIndices,
+                drawList.drawCalls
+            );
+            display(
+                "Chunk tree: %d nodes, %d visited, %d accepted whole",
+                (u32)(chunkTree.nodes.size() - chunkTree.freeNodes.size()),
+                chunkTree.nodesVisited,
+                chunkTree.nodesAccepted
             );
             display(
-                "%d vertices in %d calls",
-                drawnVertexCount, drawCallCount
+                "LOD: %d/%d/%d/%d/%d chunks per level, %d stand-ins",
+                lod.levelCounts[0], lod.levelCounts[1], lod.levelCounts[2],
+                lod.levelCounts[3], lod.levelCounts[4],
+                lod.standIns
             );
+            display(
+                "%d chunks pending, %d in flight",
+                (u32)scheduler.pending.size(), (u32)scheduler.inFlight.size()
+            );
+            display(
+                "%d pool tasks queued, %lld steals",
+                pool.queueDepth, pool.steals
+            );
+            {
+                auto deviceStats = arenaStats(chunkDeviceArena);
+                auto hostStats = arenaStats(chunkHostArena);
+                display(
+                    "Arenas: %d+%d blocks, %.2fMB used, %.0f%%/%.0f%% fragmented",
+                    deviceStats.blockCount, hostStats.blockCount,
+                    (float)(deviceStats.usedBytes + hostStats.usedBytes) / (1024 * 1024),
+                    deviceStats.fragmentation * 100.f,
+                    hostStats.fragmentation * 100.f
+                );
+            }
+            if (gpuTimers.supported) {
+                auto times = gpuTimers.stageTimes;
+                display(
+                    "GPU: %.2fms cull, %.2fms chunks, %.2fms text, %.2fms graph, %.2fms hiz, %.2fms per compute batch",
+                    times[GPU_STAGE_CULL], times[GPU_STAGE_CHUNKS],
+                    times[GPU_STAGE_TEXT], times[GPU_STAGE_GRAPH],
+                    times[GPU_STAGE_HIZ], gpuTimers.computeTime
+                );
+            }
             display(
                 "%.4fx %.4fy %.4fz %.4fw",
                 uniforms.rotation.x,
@@ -451,11 +571,18 @@ WinMain(
                 uniforms.rotation.z,
                 uniforms.rotation.w
             );
+            gpuTimerBeginStage(cmd, GPU_STAGE_TEXT);
             endText(vk, cmd);
+            gpuTimerEndStage(cmd, GPU_STAGE_TEXT);
 
-            graphDraw(vk, cmd, frameTimes, lastFrameTimeIdx);
+            gpuTimerBeginStage(cmd, GPU_STAGE_GRAPH);
+            graphDraw(vk, cmd, frameTimes, lastFrameTimeIdx, frameSlot);
+            gpuTimerEndStage(cmd, GPU_STAGE_GRAPH);
 
             vkCmdEndRenderPass(cmd);
+            gpuTimerBeginStage(cmd, GPU_STAGE_HIZ);
+            hizBuild(cmd, uniforms.eye, uniforms.rotation);
+            gpuTimerEndStage(cmd, GPU_STAGE_HIZ);
             VKCHECK(vkEndCommandBuffer(cmd))
         }
 
@@ -465,30 +592,24 @@ WinMain(
         submitInfo.commandBufferCount = 1;
         submitInfo.pCommandBuffers = &cmd;
         submitInfo.waitSemaphoreCount = 1;
-        submitInfo.pWaitSemaphores = &vk.swap.imageReady;
+        submitInfo.pWaitSemaphores = &frame.imageReady;
         VkPipelineStageFlags waitStages[] = {
             VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
         };
         submitInfo.pWaitDstStageMask = waitStages;
         submitInfo.signalSemaphoreCount = 1;
-        submitInfo.pSignalSemaphores = &vk.swap.cmdBufferDone;
-        vkQueueSubmit(vk.queue, 1, &submitInfo, VK_NULL_HANDLE);
+        submitInfo.pSignalSemaphores = &frame.renderDone;
+        VKCHECK(vkResetFences(vk.device, 1, &frame.done));
+        vkQueueSubmit(vk.queue, 1, &submitInfo, frame.done);
         VkPresentInfoKHR presentInfo = {};
         presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
         presentInfo.swapchainCount = 1;
         presentInfo.pSwapchains = &vk.swap.handle;
         presentInfo.waitSemaphoreCount = 1;
-        presentInfo.pWaitSemaphores = &vk.swap.cmdBufferDone;
+        presentInfo.pWaitSemaphores = &frame.renderDone;
         presentInfo.pImageIndices = &swapImageIndex;
         VKCHECK(vkQueuePresentKHR(vk.queue, &presentInfo));
-        vkQueueWaitIdle(vk.queue); //@perf
-
-        vkFreeCommandBuffers(
-            vk.device,
-            vk.cmdPool,
-            1,
-            &cmd
-        );
+        frameSlot = (frameSlot + 1) % framesInFlight;
 
         // Frame rate independent movement stuff.
         frameCount++;
@@ -531,12 +652,104 @@ WinMain(
             uniforms.eye.y += moveDelta;
         }
 
-        updateUniforms(vk, &uniforms, sizeof(uniforms));
     }
+    vkDeviceWaitIdle(vk.device);
 
     INFO("Average frame time: %.2fms", averageFrameTime * 1000);
     INFO("Average triangulation time: %.2fms", (triangulationTime / chunksTriangulated) * 1000);
+    if (computeRing.batchesDispatched) {
+        INFO(
+            "Compute batches: %d, %.2f chunks per batch",
+            computeRing.batchesDispatched,
+            (float)chunksTriangulated / computeRing.batchesDispatched
+        );
+    }
+    if (gpuTimers.framesTimed) {
+        for (u32 i = 0; i < GPU_STAGE_COUNT; i++) {
+            INFO(
+                "Average GPU %s time: %.2fms",
+                gpuStageNames[i],
+                (float)(gpuTimers.stageTotals[i] / gpuTimers.framesTimed)
+            );
+        }
+    }
+    if (gpuTimers.batchesTimed) {
+        INFO(
+            "Average GPU compute batch time: %.2fms, %.2fms per chunk",
+            (float)(gpuTimers.computeTotal / gpuTimers.batchesTimed),
+            (float)(gpuTimers.computeTotal / chunksTriangulated)
+        );
+    }
     INFO("Average pack time: %.2fms", (packTime / chunksPacked) * 1000);
+    if (chunksPacked) {
+        INFO(
+            "Average pack scan: %.2fKB",
+            ((float)packBytesScanned / chunksPacked) / 1024
+        );
+    }
+    if (chunksPackedTwoPass) {
+        INFO(
+            "Average two pass pack time: %.2fms (%.2fKB scanned)",
+            (packTwoPassTime / chunksPackedTwoPass) * 1000,
+            ((float)packTwoPassBytesScanned / chunksPackedTwoPass) / 1024
+        );
+    }
+    if (cpuChunksTriangulated) {
+        INFO(
+            "Average CPU triangulation time: %.2fms, %d of %d chunks had no surface",
+            (cpuTriangulationTime / cpuChunksTriangulated) * 1000,
+            cpuChunksSkipped, cpuChunksTriangulated
+        );
+    }
+    INFO(
+        "Thread pool: %lld steals, max queue depth %d, %.2fs idle",
+        pool.steals, pool.maxQueueDepth, poolIdleTime()
+    );
+    for (u32 i = 0; i < pool.workerCount; i++) {
+        INFO("Pool worker %d: %d tasks", i, pool.workers[i].tasksRun);
+    }
+    INFO(
+        "Residency: %d chunks evicted, %d moved (%.2fMB), %d known empty",
+        residency.evicted, residency.moved,
+        (float)residency.movedBytes / (1024 * 1024),
+        residency.emptyCount
+    );
+    Arena* arenas[] = { &chunkDeviceArena, &chunkHostArena };
+    for (auto arena: arenas) {
+        auto stats = arenaStats(*arena);
+        INFO(
+            "Arena %s: %d blocks, %d allocations, %.2fMB requested, %.2fMB used, %.2fMB largest free, %.0f%% fragmented, %lld frees",
+            arena->name, stats.blockCount, stats.allocationCount,
+            (float)stats.requestedBytes / (1024 * 1024),
+            (float)stats.usedBytes / (1024 * 1024),
+            (float)stats.largestFree / (1024 * 1024),
+            stats.fragmentation * 100.f,
+            arena->frees
+        );
+    }
+    if (chunkCache.enabled) {
+        INFO(
+            "Chunk cache: %d hits, %d misses, %d regions, %d chunks written (%.2fMB)",
+            chunkCache.hits, chunkCache.misses, chunkCache.regionCount,
+            chunkCache.written, (float)chunkCache.writtenBytes / (1024 * 1024)
+        );
+    }
+    if (chunkCache.loaded) {
+        INFO(
+            "Average chunk cache load time: %.2fms",
+            ((float)chunkCache.loadMicroseconds / chunkCache.loaded) / 1000
+        );
+    }
+    INFO(
+        "Scheduler: %d chunks dropped, %d cancelled",
+        scheduler.dropped, scheduler.cancelled
+    );
+    if (chunkMap.lookups) {
+        INFO(
+            "Chunk map: %.2f probes per lookup",
+            (float)chunkMap.probes / chunkMap.lookups
+        );
+    }
 
     return errorCode;
 }
@@ -0,0 +1,350 @@
+// NOTE: Scalar port of cnoise from shaders/classicnoise3D.glsl. It has to track
+// the shader closely so CPU generated chunks match GPU generated ones.
+//
+// Copyright (c) 2011 Stefan Gustavson. All rights reserved.
+// Distributed under the MIT license. See LICENSE file.
+// https://github.com/stegu/webgl-noise
+
+inline float noiseFract(float x) {
+    return x - floorf(x);
+}
+
+inline float noiseMod289(float x) {
+    return x - floorf(x * (1.f / 289.f)) * 289.f;
+}
+
+inline float noisePermute(float x) {
+    return noiseMod289(((x * 34.f) + 1.f) * x);
+}
+
+inline float noiseTaylorInvSqrt(float r) {
+    return 1.79284291400159f - 0.85373472095314f * r;
+}
+
+inline float noiseFade(float t) {
+    return t * t * t * (t * (t * 6.f - 15.f) + 10.f);
+}
+
+inline float noiseMix(float a, float b, float t) {
+    return a + (b - a) * t;
+}
+
+// Turns a permuted hash into a normalized gradient.
+inline Vec3 noiseGradient(float hash) {
+    Vec3 g;
+    g.x = hash * (1.f / 7.f);
+    g.y = noiseFract(floorf(g.x) * (1.f / 7.f)) - .5f;
+    g.x = noiseFract(g.x);
+    g.z = .5f - fabsf(g.x) - fabsf(g.y);
+    float sz = (g.z <= 0.f) ? 1.f : 0.f;
+    g.x -= sz * ((g.x >= 0.f ? 1.f : 0.f) - .5f);
+    g.y -= sz * ((g.y >= 0.f ? 1.f : 0.f) - .5f);
+    float norm = noiseTaylorInvSqrt(g.x*g.x + g.y*g.y + g.z*g.z);
+    g.x *= norm;
+    g.y *= norm;
+    g.z *= norm;
+    return g;
+}
+
+// Classic Perlin noise
+float noise(Vec3 P) {
+    Vec3 Pi0 = { floorf(P.x), floorf(P.y), floorf(P.z) };
+    Vec3 Pi1 = { Pi0.x + 1.f, Pi0.y + 1.f, Pi0.z + 1.f };
+    Pi0 = { noiseMod289(Pi0.x), noiseMod289(Pi0.y), noiseMod289(Pi0.z) };
+    Pi1 = { noiseMod289(Pi1.x), noiseMod289(Pi1.y), noiseMod289(Pi1.z) };
+    Vec3 Pf0 = { noiseFract(P.x), noiseFract(P.y), noiseFract(P.z) };
+    Vec3 Pf1 = { Pf0.x - 1.f, Pf0.y - 1.f, Pf0.z - 1.f };
+
+    // NOTE: Lanes are ordered (x0y0, x1y0, x0y1, x1y1), same as the shader.
+    float ix[4] = { Pi0.x, Pi1.x, Pi0.x, Pi1.x };
+    float iy[4] = { Pi0.y, Pi0.y, Pi1.y, Pi1.y };
+    float fx[4] = { Pf0.x, Pf1.x, Pf0.x, Pf1.x };
+    float fy[4] = { Pf0.y, Pf0.y, Pf1.y, Pf1.y };
+
+    float n_z[4];
+    Vec3 fade = { noiseFade(Pf0.x), noiseFade(Pf0.y), noiseFade(Pf0.z) };
+    for (int i = 0; i < 4; i++) {
+        float ixy = noisePermute(noisePermute(ix[i]) + iy[i]);
+        Vec3 g0 = noiseGradient(noisePermute(ixy + Pi0.z));
+        Vec3 g1 = noiseGradient(noisePermute(ixy + Pi1.z));
+        float n0 = g0.x * fx[i] + g0.y * fy[i] + g0.z * Pf0.z;
+        float n1 = g1.x * fx[i] + g1.y * fy[i] + g1.z * Pf1.z;
+        n_z[i] = noiseMix(n0, n1, fade.z);
+    }
+
+    float n_yz[2] = {
+        noiseMix(n_z[0], n_z[2], fade.y),
+        noiseMix(n_z[1], n_z[3], fade.y)
+    };
+    float n_xyz = noiseMix(n_yz[0], n_yz[1], fade.x);
+    return 2.2f * n_xyz;
+}
+
+// NOTE: The batched kernels below evaluate one point per lane. They are written
+// once against the lanes* primitives and instantiated for SSE4.1, AVX2 and
+// AVX-512. initNoise picks the widest one the CPU supports.
+
+template<typename F> F lanesSet(float x);
+template<typename F> F lanesLoad(const float* src);
+
+template<> inline __m128 lanesSet<__m128>(float x) { return _mm_set1_ps(x); }
+template<> inline __m128 lanesLoad<__m128>(const float* src) { return _mm_loadu_ps(src); }
+inline void lanesStore(float* dst, __m128 x) { _mm_storeu_ps(dst, x); }
+inline __m128 lanesAdd(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+inline __m128 lanesSub(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+inline __m128 lanesMul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+inline __m128 lanesFloor(__m128 a) { return _mm_floor_ps(a); }
+inline __m128 lanesAbs(__m128 a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+inline __m128 lanesLessEqual(__m128 a, __m128 b) { return _mm_cmple_ps(a, b); }
+inline __m128 lanesMaskZero(__m128 mask, __m128 a) { return _mm_and_ps(mask, a); }
+inline __m128 lanesSelect(__m128 mask, __m128 a, __m128 b) { return _mm_blendv_ps(b, a, mask); }
+
+template<> inline __m256 lanesSet<__m256>(float x) { return _mm256_set1_ps(x); }
+template<> inline __m256 lanesLoad<__m256>(const float* src) { return _mm256_loadu_ps(src); }
+inline void lanesStore(float* dst, __m256 x) { _mm256_storeu_ps(dst, x); }
+inline __m256 lanesAdd(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+inline __m256 lanesSub(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+inline __m256 lanesMul(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+inline __m256 lanesFloor(__m256 a) { return _mm256_floor_ps(a); }
+inline __m256 lanesAbs(__m256 a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+inline __m256 lanesLessEqual(__m256 a, __m256 b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+inline __m256 lanesMaskZero(__m256 mask, __m256 a) { return _mm256_and_ps(mask, a); }
+inline __m256 lanesSelect(__m256 mask, __m256 a, __m256 b) { return _mm256_blendv_ps(b, a, mask); }
+
+template<> inline __m512 lanesSet<__m512>(float x) { return _mm512_set1_ps(x); }
+template<> inline __m512 lanesLoad<__m512>(const float* src) { return _mm512_loadu_ps(src); }
+inline void lanesStore(float* dst, __m512 x) { _mm512_storeu_ps(dst, x); }
+inline __m512 lanesAdd(__m512 a, __m512 b) { return _mm512_add_ps(a, b); }
+inline __m512 lanesSub(__m512 a, __m512 b) { return _mm512_sub_ps(a, b); }
+inline __m512 lanesMul(__m512 a, __m512 b) { return _mm512_mul_ps(a, b); }
+inline __m512 lanesFloor(__m512 a) {
+    return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+}
+inline __m512 lanesAbs(__m512 a) { return _mm512_abs_ps(a); }
+inline __mmask16 lanesLessEqual(__m512 a, __m512 b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+inline __m512 lanesMaskZero(__mmask16 mask, __m512 a) { return _mm512_maskz_mov_ps(mask, a); }
+inline __m512 lanesSelect(__mmask16 mask, __m512 a, __m512 b) { return _mm512_mask_blend_ps(mask, b, a); }
+
+template<typename F>
+inline F noiseLanesFract(F x) {
+    return lanesSub(x, lanesFloor(x));
+}
+
+template<typename F>
+inline F noiseLanesMod289(F x) {
+    F k = lanesFloor(lanesMul(x, lanesSet<F>(1.f / 289.f)));
+    return lanesSub(x, lanesMul(k, lanesSet<F>(289.f)));
+}
+
+template<typename F>
+inline F noiseLanesPermute(F x) {
+    F y = lanesAdd(lanesMul(x, lanesSet<F>(34.f)), lanesSet<F>(1.f));
+    return noiseLanesMod289(lanesMul(y, x));
+}
+
+template<typename F>
+inline F noiseLanesFade(F t) {
+    F r = lanesSub(lanesMul(t, lanesSet<F>(6.f)), lanesSet<F>(15.f));
+    r = lanesAdd(lanesMul(t, r), lanesSet<F>(10.f));
+    return lanesMul(lanesMul(lanesMul(t, t), t), r);
+}
+
+template<typename F>
+inline F noiseLanesMix(F a, F b, F t) {
+    return lanesAdd(a, lanesMul(lanesSub(b, a), t));
+}
+
+// Gradient for a permuted hash, dotted with the offset to its lattice corner.
+template<typename F>
+inline F noiseLanesGradientDot(F hash, F fx, F fy, F fz) {
+    F half = lanesSet<F>(.5f);
+    F gx = lanesMul(hash, lanesSet<F>(1.f / 7.f));
+    F gy = lanesSub(
+        noiseLanesFract(lanesMul(lanesFloor(gx), lanesSet<F>(1.f / 7.f))),
+        half
+    );
+    gx = noiseLanesFract(gx);
+    F gz = lanesSub(lanesSub(half, lanesAbs(gx)), lanesAbs(gy));
+    auto sz = lanesLessEqual(gz, lanesSet<F>(0.f));
+    F zero = lanesSet<F>(0.f);
+    F sx = lanesSelect(lanesLessEqual(zero, gx), half, lanesSet<F>(-.5f));
+    F sy = lanesSelect(lanesLessEqual(zero, gy), half, lanesSet<F>(-.5f));
+    gx = lanesSub(gx, lanesMaskZero(sz, sx));
+    gy = lanesSub(gy, lanesMaskZero(sz, sy));
+    F lengthSquared = lanesAdd(
+        lanesAdd(lanesMul(gx, gx), lanesMul(gy, gy)),
+        lanesMul(gz, gz)
+    );
+    F norm = lanesSub(
+        lanesSet<F>(1.79284291400159f),
+        lanesMul(lanesSet<F>(0.85373472095314f), lengthSquared)
+    );
+    gx = lanesMul(gx, norm);
+    gy = lanesMul(gy, norm);
+    gz = lanesMul(gz, norm);
+    return lanesAdd(
+        lanesAdd(lanesMul(gx, fx), lanesMul(gy, fy)),
+        lanesMul(gz, fz)
+    );
+}
+
+template<typename F>
+inline F noiseLanes(F Px, F Py, F Pz) {
+    F one = lanesSet<F>(1.f);
+    F Pi0x = lanesFloor(Px);
+    F Pi0y = lanesFloor(Py);
+    F Pi0z = lanesFloor(Pz);
+    F Pf0x = lanesSub(Px, Pi0x);
+    F Pf0y = lanesSub(Py, Pi0y);
+    F Pf0z = lanesSub(Pz, Pi0z);
+    F Pi1x = noiseLanesMod289(lanesAdd(Pi0x, one));
+    F Pi1y = noiseLanesMod289(lanesAdd(Pi0y, one));
+    F Pi1z = noiseLanesMod289(lanesAdd(Pi0z, one));
+    Pi0x = noiseLanesMod289(Pi0x);
+    Pi0y = noiseLanesMod289(Pi0y);
+    Pi0z = noiseLanesMod289(Pi0z);
+    F Pf1x = lanesSub(Pf0x, one);
+    F Pf1y = lanesSub(Pf0y, one);
+    F Pf1z = lanesSub(Pf0z, one);
+
+    // NOTE: Corners are ordered (x0y0, x1y0, x0y1, x1y1), same as the shader.
+    F ix[4] = { Pi0x, Pi1x, Pi0x, Pi1x };
+    F iy[4] = { Pi0y, Pi0y, Pi1y, Pi1y };
+    F fx[4] = { Pf0x, Pf1x, Pf0x, Pf1x };
+    F fy[4] = { Pf0y, Pf0y, Pf1y, Pf1y };
+
+    F fadeZ = noiseLanesFade(Pf0z);
+    F n_z[4];
+    for (int i = 0; i < 4; i++) {
+        F ixy = noiseLanesPermute(lanesAdd(noiseLanesPermute(ix[i]), iy[i]));
+        F n0 = noiseLanesGradientDot(
+            noiseLanesPermute(lanesAdd(ixy, Pi0z)),
+            fx[i], fy[i], Pf0z
+        );
+        F n1 = noiseLanesGradientDot(
+            noiseLanesPermute(lanesAdd(ixy, Pi1z)),
+            fx[i], fy[i], Pf1z
+        );
+        n_z[i] = noiseLanesMix(n0, n1, fadeZ);
+    }
+
+    F fadeY = noiseLanesFade(Pf0y);
+    F n_yz0 = noiseLanesMix(n_z[0], n_z[2], fadeY);
+    F n_yz1 = noiseLanesMix(n_z[1], n_z[3], fadeY);
+    F n_xyz = noiseLanesMix(n_yz0, n_yz1, noiseLanesFade(Pf0x));
+    return lanesMul(n_xyz, lanesSet<F>(2.2f));
+}
+
+template<typename F>
+void noiseBatchLanes(
+    const float* x,
+    const float* y,
+    const float* z,
+    u32 count,
+    float* densities
+) {
+    const u32 width = sizeof(F) / sizeof(float);
+    u32 i = 0;
+    for (; i + width <= count; i += width) {
+        F n = noiseLanes<F>(
+            lanesLoad<F>(x + i),
+            lanesLoad<F>(y + i),
+            lanesLoad<F>(z + i)
+        );
+        lanesStore(densities + i, n);
+    }
+    for (; i < count; i++) {
+        densities[i] = noise({ x[i], y[i], z[i] });
+    }
+}
+
+void noiseBatchScalar(const float* x, const float* y, const float* z, u32 count, float* densities) {
+    for (u32 i = 0; i < count; i++) {
+        densities[i] = noise({ x[i], y[i], z[i] });
+    }
+}
+
+void noiseBatchSSE41(const float* x, const float* y, const float* z, u32 count, float* densities) {
+    noiseBatchLanes<__m128>(x, y, z, count, densities);
+}
+
+void noiseBatchAVX2(const float* x, const float* y, const float* z, u32 count, float* densities) {
+    noiseBatchLanes<__m256>(x, y, z, count, densities);
+    _mm256_zeroupper();
+}
+
+void noiseBatchAVX512(const float* x, const float* y, const float* z, u32 count, float* densities) {
+    noiseBatchLanes<__m512>(x, y, z, count, densities);
+    _mm256_zeroupper();
+}
+
+// Evaluates noise at count arbitrary points, e.g. for gameplay queries.
+void (*noiseBatch)(
+    const float* x,
+    const float* y,
+    const float* z,
+    u32 count,
+    float* densities
+) = noiseBatchScalar;
+
+struct NoisePoints {
+    vector<float> x;
+    vector<float> y;
+    vector<float> z;
+};
+
+thread_local NoisePoints noisePoints;
+
+// Evaluates noise at (origin + (x, y, z) * spacing) * scale for every point of
+// a width * height * depth lattice. Densities are stored y-major, then z, then x.
+void noiseLattice(
+    Vec3 origin,
+    float spacing,
+    float scale,
+    u32 width,
+    u32 height,
+    u32 depth,
+    float* densities
+) {
+    auto& points = noisePoints;
+    u32 count = width * height * depth;
+    points.x.resize(count);
+    points.y.resize(count);
+    points.z.resize(count);
+
+    u32 i = 0;
+    for (u32 y = 0; y < height; y++) {
+        for (u32 z = 0; z < depth; z++) {
+            for (u32 x = 0; x < width; x++) {
+                points.x[i] = (origin.x + x * spacing) * scale;
+                points.y[i] = (origin.y + y * spacing) * scale;
+                points.z[i] = (origin.z + z * spacing) * scale;
+                i++;
+            }
+        }
+    }
+
+    noiseBatch(
+        points.x.data(),
+        points.y.data(),
+        points.z.data(),
+        count,
+        densities
+    );
+}
+
+void initNoise() {
+    if (cpu.avx512f) {
+        noiseBatch = noiseBatchAVX512;
+        INFO("Noise: using AVX-512 kernel");
+    } else if (cpu.avx2) {
+        noiseBatch = noiseBatchAVX2;
+        INFO("Noise: using AVX2 kernel");
+    } else if (cpu.sse41) {
+        noiseBatch = noiseBatchSSE41;
+        INFO("Noise: using SSE4.1 kernel");
+    } else {
+        noiseBatch = noiseBatchScalar;
+        INFO("Noise: using scalar kernel");
+    }
+}
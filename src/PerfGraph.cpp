@@ -5,8 +5,9 @@ struct Graph {
     };
 
     VulkanPipeline pipeline = {};
-    VulkanBuffer vertexBuffer = {};
-    VulkanBuffer indexBuffer = {};
+    // NOTE: Rewritten every frame, so there's one of each per frame in flight.
+    VulkanBuffer vertexBuffers[framesInFlight] = {};
+    VulkanBuffer indexBuffers[framesInFlight] = {};
 
     const float height = 300.f;
     const float width = 1920.f;
@@ -32,30 +33,35 @@ void graphInit(
         0,
         vk.uniforms.handle
     );
-    createVertexBuffer(
-        vk.device,
-        vk.memories,
-        vk.queueFamily,
-        graph.vertexBufferSize,
-        graph.vertexBuffer
-    );
-    createIndexBuffer(
-        vk.device,
-        vk.memories,
-        vk.queueFamily,
-        graph.indexBufferSize,
-        graph.indexBuffer
-    );
+    for (u32 i = 0; i < framesInFlight; i++) {
+        createVertexBuffer(
+            vk.device,
+            vk.memories,
+            vk.queueFamily,
+            graph.vertexBufferSize,
+            graph.vertexBuffers[i]
+        );
+        createIndexBuffer(
+            vk.device,
+            vk.memories,
+            vk.queueFamily,
+            graph.indexBufferSize,
+            graph.indexBuffers[i]
+        );
+    }
 }
 
 void graphDraw(
     Vulkan& vk,
     VkCommandBuffer cmd,
     float* frameTimes,
-    u32 frameIdx
+    u32 frameIdx,
+    u32 frameSlot
 ) {
-    auto vertex = (Graph::Vertex*)mapMemory(vk.device, graph.vertexBuffer.memory);
-    auto index = (u16*)mapMemory(vk.device, graph.indexBuffer.memory);
+    auto& vertexBuffer = graph.vertexBuffers[frameSlot];
+    auto& indexBuffer = graph.indexBuffers[frameSlot];
+    auto vertex = (Graph::Vertex*)mapMemory(vk.device, vertexBuffer.memory);
+    auto index = (u16*)mapMemory(vk.device, indexBuffer.memory);
 
     for (u32 i = 0; i < graph.barCount; i++) {
         u32 idx = (frameIdx + i) % graph.barCount;
@@ -125,8 +131,8 @@ void graphDraw(
         *index++ = baseIdx + 0;
     }
 
-    unMapMemory(vk.device, graph.vertexBuffer.memory);
-    unMapMemory(vk.device, graph.indexBuffer.memory);
+    unMapMemory(vk.device, vertexBuffer.memory);
+    unMapMemory(vk.device, indexBuffer.memory);
 
     vkCmdBindPipeline(
         cmd,
@@ -144,12 +150,12 @@ void graphDraw(
     vkCmdBindVertexBuffers(
         cmd,
         0, 1,
-        &graph.vertexBuffer.handle,
+        &vertexBuffer.handle,
         offsets
     );
     vkCmdBindIndexBuffer(
         cmd,
-        graph.indexBuffer.handle,
+        indexBuffer.handle,
         0,
         VK_INDEX_TYPE_UINT16
     );
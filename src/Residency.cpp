@@ -0,0 +1,354 @@
+// NOTE: Owns every chunk. Chunks live in a fixed pool of slots that is never
+// reallocated, so the generate thread and the pool can hold on to Chunk*
+// while a chunk is in flight. Slots are recycled: resident chunks that fall
+// too far behind the camera are evicted, and when the pool runs dry the least
+// recently drawn chunk the level of detail selection isn't drawing makes room.
+// Only touched by the render thread.
+
+// NOTE: Stays valid across frames. Resolves to nullptr once the slot has been
+// recycled.
+struct ChunkHandle {
+    u32 idx;
+    u32 generation;
+};
+
+struct RetiredAllocation {
+    ArenaAllocation allocation;
+    u64 frame;
+};
+
+struct Residency {
+    vector<Chunk> chunks;
+    vector<u32> freeSlots;
+    // NOTE: Slots at or above this have never been used.
+    u32 slotCount;
+    u32 residentCount;
+    u64 residentBytes;
+    // NOTE: Allocations of evicted or moved chunks, freed once the GPU can no
+    // longer be using them.
+    vector<RetiredAllocation> retired;
+    // NOTE: Admitted chunks whose mesh is still in staging memory.
+    vector<ChunkHandle> uploads;
+    // NOTE: Slots whose chunk was admitted, started or stopped being drawn,
+    // had its mesh uploaded or moved, or was evicted since the draw list last
+    // looked, see drawListSync. May hold the same slot more than once.
+    vector<u32> changed;
+    u64 frame;
+    // NOTE: In level 0 chunks.
+    Vec3i regionMin;
+    Vec3i regionMax;
+    u32 evicted;
+    u32 moved;
+    u64 movedBytes;
+    // NOTE: Chunks that came back without a surface, see residencyMarkEmpty.
+    // Open addressing over residencyEmptyKey, 0 marks an empty entry.
+    vector<u64> emptyKeys;
+    u32 emptyCount;
+} residency;
+
+// NOTE: Frames the GPU may still be reading a buffer after the frame that last
+// drew it.
+const u64 residencyFrameLatency = framesInFlight;
+// NOTE: Chunks this many level 0 chunks outside the requested region are
+// evicted.
+const i32 residencyEvictMargin = chunkTreeRootSize;
+// NOTE: Arena blocks less full than this are emptied into the other blocks, at
+// most residencyDefragBudget bytes per frame.
+const float residencyDefragOccupancy = .25f;
+const VkDeviceSize residencyDefragBudget = 4 * 1024 * 1024;
+
+u32 residencyChunkIdx(Chunk* chunk) {
+    return (u32)(chunk - residency.chunks.data());
+}
+
+ChunkHandle residencyHandle(Chunk* chunk) {
+    return { residencyChunkIdx(chunk), chunk->generation };
+}
+
+void residencyChanged(Chunk* chunk) {
+    residency.changed.push_back(residencyChunkIdx(chunk));
+}
+
+Chunk* residencyResolve(ChunkHandle handle) {
+    if (handle.idx >= residency.slotCount) return nullptr;
+    auto chunk = &residency.chunks[handle.idx];
+    if (chunk->generation != handle.generation) return nullptr;
+    return chunk;
+}
+
+u64 residencyChunkBytes(Chunk* chunk) {
+    return chunk->vertexCount * sizeof(PackedVertex) +
+        chunk->indexCount * sizeof(u16);
+}
+
+void residencyRetire(ArenaAllocation& allocation) {
+    if (!allocation.arena) return;
+    residency.retired.push_back({ allocation, residency.frame });
+    allocation = {};
+}
+
+// Gives a chunk's slot back to the pool. The chunk must not be in flight.
+void residencyRelease(Chunk* chunk) {
+    chunkMapRemove(chunk);
+    u32 generation = chunk->generation + 1;
+    *chunk = {};
+    chunk->generation = generation;
+    residency.freeSlots.push_back(residencyChunkIdx(chunk));
+}
+
+void residencyEvict(Chunk* chunk) {
+    chunkTreeRemove(chunk);
+    residencyRetire(chunk->mesh);
+    residencyRetire(chunk->staging);
+    residency.residentCount--;
+    residency.residentBytes -= residencyChunkBytes(chunk);
+    residency.evicted++;
+    residencyChanged(chunk);
+    residencyRelease(chunk);
+}
+
+// Whether any part of the chunk is within margin of the requested region.
+bool residencyInRegion(Chunk* chunk, i32 margin) {
+    auto& min = residency.regionMin;
+    auto& max = residency.regionMax;
+    Vec3i base = chunkBaseCoord(*chunk);
+    i32 size = 1 << chunk->level;
+    return (base.x + size > min.x - margin) && (base.x <= max.x + margin) &&
+        (base.y + size > min.y - margin) && (base.y <= max.y + margin) &&
+        (base.z + size > min.z - margin) && (base.z <= max.z + margin);
+}
+
+// NOTE: 18 bits per coordinate, which is plenty within the requested region.
+// The transitions are part of the key since the coarser triangles on those
+// faces can lose a small surface the chunk has without them. The top bit keeps
+// every key non-zero.
+u64 residencyEmptyKey(Vec3i& coord, u32 level, u32 transitions) {
+    return (1ull << 63) |
+        ((u64)level << 60) |
+        ((u64)(transitions & 0x3f) << 54) |
+        ((u64)(coord.x & 0x3ffff) << 36) |
+        ((u64)(coord.y & 0x3ffff) << 18) |
+        (u64)(coord.z & 0x3ffff);
+}
+
+bool residencyEmptyKeyInRegion(u64 key, i32 margin) {
+    // NOTE: Shift the coordinates up to the top of an i32 and back down to
+    // sign extend them.
+    Chunk chunk = {};
+    chunk.level = (u32)(key >> 60) & 7;
+    chunk.coord = {
+        (i32)((u32)(key >> 36) << 14) >> 14,
+        (i32)((u32)(key >> 18) << 14) >> 14,
+        (i32)((u32)key << 14) >> 14
+    };
+    return residencyInRegion(&chunk, margin);
+}
+
+u32 residencyEmptySlot(u64 key) {
+    u32 mask = (u32)residency.emptyKeys.size() - 1;
+    u32 idx = (u32)((key * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+    while (residency.emptyKeys[idx] && (residency.emptyKeys[idx] != key)) {
+        idx = (idx + 1) & mask;
+    }
+    return idx;
+}
+
+bool residencyKnownEmpty(Vec3i coord, u32 level, u32 transitions) {
+    u64 key = residencyEmptyKey(coord, level, transitions);
+    return residency.emptyKeys[residencyEmptySlot(key)] == key;
+}
+
+// Remembers that the chunk has no surface with its transitions, so it is never
+// generated again while it stays near the requested region. Past half
+// full, the table is rebuilt without the chunks that left it, and grows if
+// that isn't enough.
+void residencyMarkEmpty(Chunk* chunk) {
+    u64 key = residencyEmptyKey(chunk->coord, chunk->level, chunk->transitions);
+    u32 idx = residencyEmptySlot(key);
+    if (residency.emptyKeys[idx]) return;
+    residency.emptyKeys[idx] = key;
+    residency.emptyCount++;
+    if (residency.emptyCount * 2 < residency.emptyKeys.size()) return;
+
+    vector<u64> keys;
+    keys.swap(residency.emptyKeys);
+    u32 kept = 0;
+    for (auto k: keys) {
+        if (k && residencyEmptyKeyInRegion(k, residencyEvictMargin)) kept++;
+    }
+    u32 size = (u32)keys.size();
+    while (kept * 2 >= size) size <<= 1;
+    residency.emptyKeys.resize(size);
+    residency.emptyCount = 0;
+    for (auto k: keys) {
+        if (!k || !residencyEmptyKeyInRegion(k, residencyEvictMargin)) continue;
+        residency.emptyKeys[residencyEmptySlot(k)] = k;
+        residency.emptyCount++;
+    }
+}
+
+// Evicts the least recently drawn resident chunk that isn't being drawn.
+bool residencyEvictLRU() {
+    Chunk* victim = nullptr;
+    for (u32 i = 0; i < residency.slotCount; i++) {
+        auto chunk = &residency.chunks[i];
+        if (chunk->state != CHUNK_RESIDENT) continue;
+        if (chunk->drawn) continue;
+        if (!victim || (chunk->lastDrawnFrame < victim->lastDrawnFrame)) {
+            victim = chunk;
+        }
+    }
+    if (!victim) return false;
+    residencyEvict(victim);
+    return true;
+}
+
+// Returns nullptr if every slot holds a chunk that is still wanted.
+Chunk* residencyAllocate() {
+    if (residency.freeSlots.empty()) {
+        if (residency.slotCount < residency.chunks.size()) {
+            return &residency.chunks[residency.slotCount++];
+        }
+        if (!residencyEvictLRU()) return nullptr;
+    }
+    u32 idx = residency.freeSlots.back();
+    residency.freeSlots.pop_back();
+    return &residency.chunks[idx];
+}
+
+// Called once the chunk has been seen as READY by the render thread.
+void residencyAdmit(Chunk* chunk) {
+    // NOTE: Nothing to draw, and nothing to stand in for other chunks with, so
+    // only the coordinate is kept.
+    if (!chunk->indexCount) {
+        residencyMarkEmpty(chunk);
+        residencyRelease(chunk);
+        return;
+    }
+    chunk->state = CHUNK_RESIDENT;
+    residency.residentCount++;
+    residency.residentBytes += residencyChunkBytes(chunk);
+    chunk->lastDrawnFrame = residency.frame;
+    if (chunk->staging.arena) {
+        residency.uploads.push_back(residencyHandle(chunk));
+    }
+    residencyChanged(chunk);
+}
+
+void residencyTouch(Chunk* chunk) {
+    chunk->lastDrawnFrame = residency.frame;
+}
+
+// NOTE: Call once per frame, after the previous frame's command buffer was
+// submitted.
+void residencyUpdate(Vulkan& vk, Vec3i regionMin, Vec3i regionMax) {
+    residency.frame++;
+    residency.regionMin = regionMin;
+    residency.regionMax = regionMax;
+
+    auto& retired = residency.retired;
+    for (u32 i = 0; i < retired.size();) {
+        if (residency.frame - retired[i].frame > residencyFrameLatency) {
+            arenaFree(retired[i].allocation);
+            retired[i] = retired.back();
+            retired.pop_back();
+        } else {
+            i++;
+        }
+    }
+    arenaTrim(chunkDeviceArena, vk);
+    arenaTrim(chunkHostArena, vk);
+
+    for (u32 i = 0; i < residency.slotCount; i++) {
+        auto chunk = &residency.chunks[i];
+        if (chunk->state != CHUNK_RESIDENT) continue;
+        if (!residencyInRegion(chunk, residencyEvictMargin)) {
+            residencyEvict(chunk);
+        }
+    }
+}
+
+void residencyCopy(
+    VkCommandBuffer cmd,
+    ArenaAllocation& src,
+    ArenaAllocation& dst
+) {
+    VkBufferCopy region = {};
+    region.srcOffset = src.offset;
+    region.dstOffset = dst.offset;
+    region.size = src.size;
+    vkCmdCopyBuffer(cmd, src.buffer, dst.buffer, 1, &region);
+}
+
+// Copies the meshes of newly admitted CPU chunks out of staging memory.
+// Returns true if anything was recorded.
+bool residencyUpload(Vulkan& vk, VkCommandBuffer cmd) {
+    bool copied = false;
+    for (auto handle: residency.uploads) {
+        auto chunk = residencyResolve(handle);
+        if (!chunk || !chunk->staging.arena) continue;
+        arenaAllocate(chunkDeviceArena, vk, chunk->staging.size, chunk->mesh);
+        residencyCopy(cmd, chunk->staging, chunk->mesh);
+        residencyRetire(chunk->staging);
+        residencyChanged(chunk);
+        copied = true;
+    }
+    residency.uploads.clear();
+    return copied;
+}
+
+// Empties the sparsest block of the device arena into the others a few chunks
+// at a time, so arenaTrim can give it back. Returns true if anything was
+// recorded.
+bool residencyDefragment(Vulkan& vk, VkCommandBuffer cmd) {
+    auto& arena = chunkDeviceArena;
+    i32 block = arenaSparsestBlock(arena, residencyDefragOccupancy);
+    if (block < 0) return false;
+
+    bool copied = false;
+    VkDeviceSize budget = residencyDefragBudget;
+    for (u32 i = 0; (i < residency.slotCount) && (budget > 0); i++) {
+        auto chunk = &residency.chunks[i];
+        if (chunk->state != CHUNK_RESIDENT) continue;
+        auto& mesh = chunk->mesh;
+        if ((mesh.arena != &arena) || ((i32)mesh.block != block)) continue;
+
+        ArenaAllocation moved = {};
+        if (!arenaAllocate(arena, vk, mesh.size, moved, block)) break;
+        residencyCopy(cmd, mesh, moved);
+        // NOTE: Earlier frames may still draw from the old location.
+        residencyRetire(mesh);
+        mesh = moved;
+        residencyChanged(chunk);
+
+        residency.moved++;
+        residency.movedBytes += moved.size;
+        budget = (moved.size < budget) ? budget - moved.size : 0;
+        copied = true;
+    }
+    return copied;
+}
+
+// Records this frame's mesh uploads and moves into cmd, which has to run them
+// before anything in it draws chunks.
+void residencyTransfer(Vulkan& vk, VkCommandBuffer cmd) {
+    bool copied = residencyUpload(vk, cmd);
+    copied |= residencyDefragment(vk, cmd);
+    if (!copied) return;
+
+    bufferBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT
+    );
+}
+
+void initResidency(u32 slotCount) {
+    residency.chunks.resize(slotCount);
+    u32 emptySize = 1;
+    while (emptySize < slotCount) emptySize <<= 1;
+    residency.emptyKeys.resize(emptySize);
+    initChunkMap(slotCount);
+}
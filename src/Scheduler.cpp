@@ -0,0 +1,129 @@
+#include <algorithm>
+
+// NOTE: Decides which chunks get generated, and in which order. Only ever
+// touched by the render thread. Requested chunks wait here until there is
+// room in flight, so the generate work queue stays shallow and the order can
+// still change every frame as the camera moves.
+
+struct SchedulerCandidate {
+    float priority;
+    Chunk* chunk;
+};
+
+struct Scheduler {
+    vector<Chunk*> pending;
+    // NOTE: Handed to the generate thread and not READY or given back yet.
+    vector<Chunk*> inFlight;
+    vector<SchedulerCandidate> candidates;
+    u32 maxInFlight;
+    u32 dropped;
+    u32 cancelled;
+} scheduler;
+
+// Lower is sooner. Distance from the eye to the chunk's center, stretched by
+// up to 3x for chunks behind the camera.
+float schedulerPriority(Chunk* chunk, Vec3& eye, Vec3& forward) {
+    Vec3 toChunk = {
+        (chunk->coord.x + .5f) * (computeWidth << chunk->level) - eye.x,
+        (chunk->coord.y + .5f) * (computeHeight << chunk->level) - eye.y,
+        (chunk->coord.z + .5f) * (computeDepth << chunk->level) - eye.z
+    };
+    float distance = sqrtf(
+        toChunk.x * toChunk.x +
+        toChunk.y * toChunk.y +
+        toChunk.z * toChunk.z
+    );
+    if (distance < 1e-3f) return 0.f;
+    float cosAngle = (
+        toChunk.x * forward.x +
+        toChunk.y * forward.y +
+        toChunk.z * forward.z
+    ) / distance;
+    return distance * (2.f - cosAngle);
+}
+
+void schedulerRequest(Chunk* chunk, Vec3i coord, u32 level, u32 transitions) {
+    chunk->coord = coord;
+    chunk->level = level;
+    chunk->transitions = transitions;
+    chunk->state = CHUNK_PENDING;
+    chunkMapInsert(chunk);
+    scheduler.pending.push_back(chunk);
+}
+
+void schedulerUpdate(
+    Vulkan& vk,
+    Vec3 eye,
+    Vec3 forward
+) {
+    // Retire finished work and cancel queued work that is no longer wanted.
+    auto& inFlight = scheduler.inFlight;
+    for (u32 i = 0; i < inFlight.size();) {
+        auto chunk = inFlight[i];
+        if ((chunk->state == CHUNK_QUEUED) && !lodWanted(chunk, eye)) {
+            auto previousState = InterlockedCompareExchange(
+                &chunk->state,
+                CHUNK_CANCELLED,
+                CHUNK_QUEUED
+            );
+            if (previousState == CHUNK_QUEUED) scheduler.cancelled++;
+        }
+
+        LONG state = chunk->state;
+        if ((state == CHUNK_READY) || (state == CHUNK_FREE)) {
+            if (state == CHUNK_READY) residencyAdmit(chunk);
+            if (state == CHUNK_FREE) residencyRelease(chunk);
+            inFlight[i] = inFlight.back();
+            inFlight.pop_back();
+        } else {
+            i++;
+        }
+    }
+
+    // Drop pending chunks the level of detail no longer wants and order the
+    // rest.
+    auto& candidates = scheduler.candidates;
+    candidates.clear();
+    for (auto chunk: scheduler.pending) {
+        if (!lodWanted(chunk, eye)) {
+            residencyRelease(chunk);
+            scheduler.dropped++;
+            continue;
+        }
+        candidates.push_back({ schedulerPriority(chunk, eye, forward), chunk });
+    }
+    std::sort(
+        candidates.begin(),
+        candidates.end(),
+        [](SchedulerCandidate& a, SchedulerCandidate& b) {
+            return a.priority < b.priority;
+        }
+    );
+
+    // Hand the most urgent chunks to the generate thread.
+    u32 candidateIdx = 0;
+    for (; candidateIdx < candidates.size(); candidateIdx++) {
+        if (inFlight.size() >= scheduler.maxInFlight) break;
+
+        auto chunk = candidates[candidateIdx].chunk;
+        chunk->state = CHUNK_QUEUED;
+        GenerateWorkItem workItem = {};
+        workItem.vk = &vk;
+        workItem.chunk = chunk;
+        workItem.generation = chunk->generation;
+        if (!generatePushWorkItem(workItem)) {
+            chunk->state = CHUNK_PENDING;
+            break;
+        }
+        inFlight.push_back(chunk);
+    }
+
+    scheduler.pending.clear();
+    for (; candidateIdx < candidates.size(); candidateIdx++) {
+        scheduler.pending.push_back(candidates[candidateIdx].chunk);
+    }
+}
+
+void initScheduler(u32 maxInFlight) {
+    scheduler.maxInFlight = maxInFlight;
+}
@@ -7,27 +7,30 @@ stbtt_bakedchar bakedChars[96];
 
 u32 textLineCount = 0;
 VulkanPipeline textPipeline;
-VulkanBuffer textVertexBuffer;
-VulkanBuffer textIndexBuffer;
+// NOTE: Rewritten every frame, so there's one of each per frame in flight.
+VulkanBuffer textVertexBuffers[framesInFlight];
+VulkanBuffer textIndexBuffers[framesInFlight];
 u32 textMaxCharacters = 25 * 100;
 u32 textVertexBufferSize = sizeof(TextVertex) * 4 * textMaxCharacters;
 u32 textIndexBufferSize = sizeof(u32) * 6 * textMaxCharacters;
 u32 textCurrentCharacter = 0;
 u32 textVertexCount = 0;
 u32 textIndexCount = 0;
-TextVertex *textVertices = nullptr;
+TextVertex* textVertices[framesInFlight] = {};
 TextVertex* textCurrentVertex = nullptr;
-u32* textIndices = nullptr;
+u32* textIndices[framesInFlight] = {};
 u32* textCurrentIndex = nullptr;
+u32 textFrameSlot = 0;
 char* textBuffer = nullptr;
 
-void startText() {
+void startText(u32 frameSlot) {
     textCurrentCharacter = 0;
     textLineCount = 0;
     textVertexCount = 0;
     textIndexCount = 0;
-    textCurrentVertex = textVertices;
-    textCurrentIndex = textIndices;
+    textFrameSlot = frameSlot;
+    textCurrentVertex = textVertices[frameSlot];
+    textCurrentIndex = textIndices[frameSlot];
 }
 
 #define display(fmt, ...) {\
@@ -94,22 +97,24 @@ void initText(
         &fontAtlas,
         1
     );
-    createVertexBuffer(
-        vk.device,
-        vk.memories,
-        vk.queueFamily,
-        textVertexBufferSize,
-        textVertexBuffer
-    );
-    textVertices = (TextVertex*)mapMemory(vk.device, textVertexBuffer.memory);
-    createIndexBuffer(
-        vk.device,
-        vk.memories,
-        vk.queueFamily,
-        textIndexBufferSize,
-        textIndexBuffer
-    );
-    textIndices = (u32*)mapMemory(vk.device, textIndexBuffer.memory);
+    for (u32 i = 0; i < framesInFlight; i++) {
+        createVertexBuffer(
+            vk.device,
+            vk.memories,
+            vk.queueFamily,
+            textVertexBufferSize,
+            textVertexBuffers[i]
+        );
+        textVertices[i] = (TextVertex*)mapMemory(vk.device, textVertexBuffers[i].memory);
+        createIndexBuffer(
+            vk.device,
+            vk.memories,
+            vk.queueFamily,
+            textIndexBufferSize,
+            textIndexBuffers[i]
+        );
+        textIndices[i] = (u32*)mapMemory(vk.device, textIndexBuffers[i].memory);
+    }
 }
 
 void endText(
@@ -182,12 +187,12 @@ void endText(
     vkCmdBindVertexBuffers(
         cmd,
         0, 1,
-        &textVertexBuffer.handle,
+        &textVertexBuffers[textFrameSlot].handle,
         offsets
     );
     vkCmdBindIndexBuffer(
         cmd,
-        textIndexBuffer.handle,
+        textIndexBuffers[textFrameSlot].handle,
         0,
         VK_INDEX_TYPE_UINT32 //FIXME: should be 16
     );
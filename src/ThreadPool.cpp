@@ -0,0 +1,203 @@
+#include <deque>
+
+// NOTE: Persistent pool of worker threads for CPU work (meshing, packing,
+// ...). Every worker owns a deque of tasks. It pushes and pops its own tasks at
+// the back, and when it runs dry it steals from the front of the other
+// workers' deques, so the oldest (usually biggest) work moves between threads.
+
+typedef void (*PoolTaskFunction)(void* data);
+
+struct PoolTask {
+    PoolTaskFunction function;
+    void* data;
+    volatile LONG done;
+    // NOTE: One reference for the pool and one for the handle returned by
+    // poolSubmit. The task is freed when both are gone.
+    volatile LONG refCount;
+};
+
+struct PoolWorker {
+    SRWLOCK lock;
+    std::deque<PoolTask*> tasks;
+    float idleTime;
+    u32 tasksRun;
+};
+
+struct ThreadPool {
+    PoolWorker* workers;
+    u32 workerCount;
+    HANDLE wakeSemaphore;
+    volatile LONG nextWorker;
+    volatile LONG sleepingCount;
+    // NOTE: Tasks submitted but not yet picked up by a worker.
+    volatile LONG queueDepth;
+    LONG maxQueueDepth;
+    volatile LONG64 steals;
+} pool;
+
+thread_local i32 poolWorkerIdx = -1;
+
+void poolRelease(PoolTask* task) {
+    if (InterlockedDecrement(&task->refCount) == 0) {
+        delete task;
+    }
+}
+
+bool poolTaskDone(PoolTask* task) {
+    return task->done != 0;
+}
+
+PoolTask* poolPop(u32 workerIdx) {
+    auto& worker = pool.workers[workerIdx];
+    PoolTask* task = nullptr;
+    AcquireSRWLockExclusive(&worker.lock);
+    if (!worker.tasks.empty()) {
+        task = worker.tasks.back();
+        worker.tasks.pop_back();
+    }
+    ReleaseSRWLockExclusive(&worker.lock);
+    return task;
+}
+
+PoolTask* poolSteal(u32 victimIdx) {
+    auto& victim = pool.workers[victimIdx];
+    PoolTask* task = nullptr;
+    // NOTE: Don't wait on a busy victim, just move on to the next one.
+    if (!TryAcquireSRWLockExclusive(&victim.lock)) return nullptr;
+    if (!victim.tasks.empty()) {
+        task = victim.tasks.front();
+        victim.tasks.pop_front();
+    }
+    ReleaseSRWLockExclusive(&victim.lock);
+    return task;
+}
+
+// Finds a task for the calling thread, first in its own deque (if it is a
+// worker) and then in everyone else's.
+PoolTask* poolFindTask() {
+    PoolTask* task = nullptr;
+    u32 start = 0;
+    if (poolWorkerIdx >= 0) {
+        task = poolPop(poolWorkerIdx);
+        start = poolWorkerIdx + 1;
+    }
+    for (u32 i = 0; !task && (i < pool.workerCount); i++) {
+        u32 victimIdx = (start + i) % pool.workerCount;
+        if ((i32)victimIdx == poolWorkerIdx) continue;
+        task = poolSteal(victimIdx);
+        if (task) InterlockedIncrement64(&pool.steals);
+    }
+    if (task) InterlockedDecrement(&pool.queueDepth);
+    return task;
+}
+
+void poolRun(PoolTask* task) {
+    task->function(task->data);
+    InterlockedExchange(&task->done, 1);
+    if (poolWorkerIdx >= 0) {
+        pool.workers[poolWorkerIdx].tasksRun++;
+    }
+    poolRelease(task);
+}
+
+// Queues function to run on the pool. The returned handle can be waited on
+// with poolWait and has to be given back with poolRelease.
+PoolTask* poolSubmit(PoolTaskFunction function, void* data) {
+    auto task = new PoolTask;
+    task->function = function;
+    task->data = data;
+    task->done = 0;
+    task->refCount = 2;
+
+    // NOTE: Workers keep what they spawn, everyone else spreads tasks around.
+    u32 workerIdx = (poolWorkerIdx >= 0) ?
+        poolWorkerIdx :
+        (u32)InterlockedIncrement(&pool.nextWorker) % pool.workerCount;
+    auto& worker = pool.workers[workerIdx];
+    AcquireSRWLockExclusive(&worker.lock);
+    worker.tasks.push_back(task);
+    ReleaseSRWLockExclusive(&worker.lock);
+
+    LONG depth = InterlockedIncrement(&pool.queueDepth);
+    if (depth > pool.maxQueueDepth) pool.maxQueueDepth = depth;
+
+    // NOTE: A worker going to sleep increments sleepingCount before it checks
+    // queueDepth one last time, so one of the two always sees the other.
+    if (pool.sleepingCount > 0) {
+        ReleaseSemaphore(pool.wakeSemaphore, 1, nullptr);
+    }
+    return task;
+}
+
+// Blocks until task has run. Runs other tasks while it waits instead of
+// sleeping, so tasks can wait on tasks they submitted without deadlocking.
+void poolWait(PoolTask* task) {
+    while (!poolTaskDone(task)) {
+        auto other = poolFindTask();
+        if (other) {
+            poolRun(other);
+        } else {
+            YieldProcessor();
+        }
+    }
+}
+
+DWORD WINAPI PoolThread(LPVOID param) {
+    poolWorkerIdx = (i32)(uintptr_t)param;
+    auto& worker = pool.workers[poolWorkerIdx];
+    while (true) {
+        auto task = poolFindTask();
+        if (task) {
+            poolRun(task);
+            continue;
+        }
+
+        InterlockedIncrement(&pool.sleepingCount);
+        if (pool.queueDepth > 0) {
+            InterlockedDecrement(&pool.sleepingCount);
+            continue;
+        }
+        START_TIMER(Idle);
+        WaitForSingleObject(pool.wakeSemaphore, INFINITE);
+        END_TIMER(Idle);
+        worker.idleTime += DELTA(Idle);
+        InterlockedDecrement(&pool.sleepingCount);
+    }
+}
+
+float poolIdleTime() {
+    float idleTime = 0.f;
+    for (u32 i = 0; i < pool.workerCount; i++) {
+        idleTime += pool.workers[i].idleTime;
+    }
+    return idleTime;
+}
+
+void initPool(u32 workerCount) {
+    pool.workerCount = workerCount;
+    pool.workers = new PoolWorker[workerCount];
+    pool.wakeSemaphore = CreateSemaphore(
+        nullptr,
+        0,
+        MAXLONG,
+        nullptr
+    );
+    CHECK(pool.wakeSemaphore, "Could not create semaphore");
+
+    for (u32 i = 0; i < workerCount; i++) {
+        auto& worker = pool.workers[i];
+        InitializeSRWLock(&worker.lock);
+        worker.idleTime = 0.f;
+        worker.tasksRun = 0;
+        auto thread = CreateThread(
+            nullptr,
+            0,
+            PoolThread,
+            (LPVOID)(uintptr_t)i,
+            0,
+            nullptr
+        );
+        CHECK(thread, "Could not create pool thread");
+    }
+    INFO("Thread pool: %d workers", workerCount);
+}